@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <mutex>
+#include <chrono>
 #include "cmaj_Performer.h"
 
 namespace cmaj
@@ -97,6 +99,15 @@ struct Engine
     /// If the ID isn't found, this will return an invalid handle.
     EndpointHandle getEndpointHandle (const char* endpointID) const;
 
+    /// Returns a handle for an endpoint whose data type is known at compile-time.
+    /// This checks that the endpoint exists, is of the given endpoint type, and has a data type
+    /// that matches the ElementType and number of channels. If not, the TypedEndpoint that is
+    /// returned will be invalid. The check is only done here, so the Performer methods that
+    /// take the resulting TypedEndpoint don't need to do any runtime type-checking.
+    /// This may be called after successfully loading a program, and before linking has happened.
+    template <typename ElementType, EndpointType endpointType, uint32_t numChannels = 1>
+    TypedEndpoint<ElementType, endpointType, numChannels> getTypedEndpoint (const char* endpointID) const;
+
     //==============================================================================
     /// Returns a list describing all the external variables in the loaded program.
     /// This may be called after successfully loading a program, at which point all these
@@ -113,6 +124,8 @@ struct Engine
     /// If a program has been successfully loaded, this returns a JSON object with
     /// information about its properties.
     /// This may be called after successfully loading a program.
+    /// The details are parsed once and cached, so calling this (or the endpoint-list
+    /// methods) repeatedly is cheap.
     choc::value::Value getProgramDetails() const;
 
     //==============================================================================
@@ -132,6 +145,20 @@ struct Engine
     /// program.
     Performer createPerformer();
 
+    /// Describes what happened during the most recent call to link().
+    struct LinkInfo
+    {
+        /// True if a cache was supplied, and the linker managed to reload the program from it
+        bool usedCachedBinary = false;
+        /// The time that link() took to run
+        double linkSeconds = 0;
+        uint64_t cacheBytesRead = 0, cacheBytesWritten = 0;
+    };
+
+    /// Returns information about the last call to link(). This can be useful for
+    /// spotting whether a cache is being used as expected.
+    LinkInfo getLastLinkInfo() const;
+
     /// Returns true if a program has been successfully loaded, but not yet linked.
     bool isLoaded() const;
 
@@ -164,6 +191,17 @@ struct Engine
 
 private:
     Library::SharedLibraryPtr library;
+
+    struct CachedProgramDetails;
+    struct SharedState;
+    struct LinkCacheMonitor;
+
+    /// Shared between copies of this Engine, as they all refer to the same underlying engine
+    std::shared_ptr<SharedState> sharedState;
+
+    std::shared_ptr<const CachedProgramDetails> getCachedProgramDetails() const;
+    std::shared_ptr<const CachedProgramDetails> parseProgramDetails() const;
+    void clearCachedProgramDetails();
 };
 
 
@@ -179,7 +217,10 @@ private:
 //
 //==============================================================================
 
-inline Engine::Engine (EnginePtr p) : engine (p), library (Library::getSharedLibraryPtr()) {}
+inline Engine::Engine (EnginePtr p)
+    : engine (p), library (Library::getSharedLibraryPtr()),
+      sharedState (std::make_shared<SharedState>())
+{}
 
 inline Engine::~Engine()
 {
@@ -218,6 +259,105 @@ inline void Engine::setBuildSettings (const BuildSettings& newSettings)
         engine->setBuildSettings (newSettings.toJSON().c_str());
 }
 
+//==============================================================================
+struct Engine::CachedProgramDetails
+{
+    choc::value::Value details;
+    EndpointDetailsList inputs, outputs;
+};
+
+struct Engine::SharedState
+{
+    std::mutex lock;
+    std::shared_ptr<const CachedProgramDetails> programDetails;
+    LinkInfo lastLinkInfo;
+};
+
+/// Passes the linker's calls through to the real cache, counting the bytes that go in and out
+struct Engine::LinkCacheMonitor  : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseInterface, LinkCacheMonitor>
+{
+    LinkCacheMonitor (CacheDatabaseInterface& c) : target (c) {}
+    virtual ~LinkCacheMonitor() = default;
+
+    void store (const char* key, const void* dataToSave, uint64_t dataSize) override
+    {
+        bytesWritten += dataSize;
+        target.store (key, dataToSave, dataSize);
+    }
+
+    uint64_t reload (const char* key, void* destAddress, uint64_t destSize) override
+    {
+        auto size = target.reload (key, destAddress, destSize);
+
+        if (destAddress != nullptr && size != 0 && size <= destSize)
+            bytesRead += size;
+
+        return size;
+    }
+
+    CacheDatabaseMappedRegion* reloadMapped (const char* key) override
+    {
+        auto region = target.reloadMapped (key);
+
+        if (region != nullptr)
+            bytesRead += region->getSize();
+
+        return region;
+    }
+
+    CacheDatabaseInterface& target;
+    uint64_t bytesRead = 0, bytesWritten = 0;
+};
+
+inline std::shared_ptr<const Engine::CachedProgramDetails> Engine::parseProgramDetails() const
+{
+    auto result = std::make_shared<CachedProgramDetails>();
+
+    if (auto details = engine->getProgramDetails())
+    {
+        try
+        {
+            result->details = choc::json::parse (choc::com::StringPtr (details));
+
+            if (result->details.isObject())
+            {
+                result->inputs  = EndpointDetailsList::fromJSON (result->details["inputs"], true);
+                result->outputs = EndpointDetailsList::fromJSON (result->details["outputs"], false);
+            }
+        }
+        catch (...) {}
+    }
+
+    return result;
+}
+
+inline std::shared_ptr<const Engine::CachedProgramDetails> Engine::getCachedProgramDetails() const
+{
+    // This method is only valid on a loaded engine
+    if (! isLoaded())
+        return {};
+
+    // An engine that wasn't created with the normal constructor has nowhere to keep things
+    if (sharedState == nullptr)
+        return parseProgramDetails();
+
+    std::lock_guard<std::mutex> l (sharedState->lock);
+
+    if (sharedState->programDetails == nullptr)
+        sharedState->programDetails = parseProgramDetails();
+
+    return sharedState->programDetails;
+}
+
+inline void Engine::clearCachedProgramDetails()
+{
+    if (sharedState != nullptr)
+    {
+        std::lock_guard<std::mutex> l (sharedState->lock);
+        sharedState->programDetails.reset();
+    }
+}
+
 inline bool Engine::load (DiagnosticMessageList& messages, const Program& programToLoad)
 {
     // You need to create a valid Engine using Engine::create() before you can load things into it.
@@ -227,6 +367,8 @@ inline bool Engine::load (DiagnosticMessageList& messages, const Program& progra
         return false;
     }
 
+    clearCachedProgramDetails();
+
     if (auto result = choc::com::StringPtr (engine->load (programToLoad.program.get())))
         return messages.addFromJSONString (result);
 
@@ -235,26 +377,24 @@ inline bool Engine::load (DiagnosticMessageList& messages, const Program& progra
 
 inline void Engine::unload()
 {
+    clearCachedProgramDetails();
+
     if (engine != nullptr)
         engine->unload();
 }
 
 inline EndpointDetailsList Engine::getInputEndpoints() const
 {
-    auto details = getProgramDetails();
-
-    if (details.isObject())
-        return EndpointDetailsList::fromJSON (details["inputs"], true);
+    if (auto cached = getCachedProgramDetails())
+        return cached->inputs;
 
     return {};
 }
 
 inline EndpointDetailsList Engine::getOutputEndpoints() const
 {
-    auto details = getProgramDetails();
-
-    if (details.isObject())
-        return EndpointDetailsList::fromJSON (details["outputs"], false);
+    if (auto cached = getCachedProgramDetails())
+        return cached->outputs;
 
     return {};
 }
@@ -268,16 +408,55 @@ inline EndpointHandle Engine::getEndpointHandle (const char* endpointID) const
     return engine->getEndpointHandle (endpointID);
 }
 
+template <typename ElementType, EndpointType endpointType, uint32_t numChannels>
+TypedEndpoint<ElementType, endpointType, numChannels> Engine::getTypedEndpoint (const char* endpointID) const
+{
+    TypedEndpoint<ElementType, endpointType, numChannels> result;
+
+    if (endpointID == nullptr || ! isLoaded())
+        return result;
+
+    auto cached = getCachedProgramDetails();
+
+    if (cached == nullptr)
+        return result;
+
+    auto findIn = [&] (const EndpointDetailsList& endpoints)
+    {
+        for (auto& e : endpoints)
+        {
+            if (e.endpointType == endpointType && e.endpointID.toString() == endpointID)
+            {
+                for (uint32_t i = 0; i < e.dataTypes.size(); ++i)
+                {
+                    if (result.isMatchingType (e.dataTypes[i]))
+                    {
+                        result.handle = getEndpointHandle (endpointID);
+                        result.typeIndex = i;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    };
+
+    if (! findIn (cached->inputs))
+        findIn (cached->outputs);
+
+    return result;
+}
+
 inline ExternalVariableList Engine::getExternalVariables() const
 {
     // This method is only valid on a loaded but not-yet-linked engine
     if (! isLoaded() || isLinked())
         return {};
 
-    auto details = getProgramDetails();
-
-    if (details.isObject())
-        return ExternalVariableList::fromJSON (details["externals"]);
+    if (auto cached = getCachedProgramDetails())
+        if (cached->details.isObject())
+            return ExternalVariableList::fromJSON (cached->details["externals"]);
 
     return {};
 }
@@ -294,21 +473,8 @@ inline bool Engine::setExternalVariable (const char* name, const choc::value::Va
 
 inline choc::value::Value Engine::getProgramDetails() const
 {
-    // This method is only valid on a loaded engine
-    if (! isLoaded())
-        return {};
-
-    if (engine != nullptr)
-    {
-        if (auto details = engine->getProgramDetails())
-        {
-            try
-            {
-                return choc::json::parse (choc::com::StringPtr (details));
-            }
-            catch (...) {}
-        }
-    }
+    if (auto cached = getCachedProgramDetails())
+        return cached->details;
 
     return {};
 }
@@ -322,12 +488,47 @@ inline bool Engine::link (DiagnosticMessageList& messages, CacheDatabaseInterfac
        return false;
    }
 
-    if (auto result = choc::com::StringPtr (engine->link (cache)))
+    clearCachedProgramDetails();
+
+    choc::com::Ptr<LinkCacheMonitor> monitor;
+
+    if (cache != nullptr)
+        monitor = choc::com::create<LinkCacheMonitor> (*cache);
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto result = choc::com::StringPtr (engine->link (monitor.get()));
+
+    LinkInfo info;
+    info.linkSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - startTime).count();
+
+    if (monitor != nullptr)
+    {
+        info.usedCachedBinary = monitor->bytesRead != 0;
+        info.cacheBytesRead = monitor->bytesRead;
+        info.cacheBytesWritten = monitor->bytesWritten;
+    }
+
+    if (sharedState != nullptr)
+    {
+        std::lock_guard<std::mutex> l (sharedState->lock);
+        sharedState->lastLinkInfo = info;
+    }
+
+    if (result)
         return messages.addFromJSONString (result);
 
     return true;
 }
 
+inline Engine::LinkInfo Engine::getLastLinkInfo() const
+{
+    if (sharedState == nullptr)
+        return {};
+
+    std::lock_guard<std::mutex> l (sharedState->lock);
+    return sharedState->lastLinkInfo;
+}
+
 inline Performer Engine::createPerformer()
 {
     // This method is only valid on a fully-linked engine
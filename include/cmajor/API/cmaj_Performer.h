@@ -22,15 +22,59 @@
 #pragma once
 
 #include <cassert>
+#include <array>
 
 #include "cmaj_Program.h"
 #include "cmaj_Endpoints.h"
 #include "cmaj_ExternalVariables.h"
+#include "../COM/cmaj_ExtendedPerformerInterface.h"
 #include "../../choc/audio/choc_SampleBufferUtilities.h"
 
 namespace cmaj
 {
 
+//==============================================================================
+/// An endpoint handle whose data type is fixed at compile-time.
+///
+/// The ElementType can be float, double, int32_t or int64_t, and if numChannels is
+/// more than 1, the endpoint's type must be a vector of that many elements. Use
+/// Engine::getTypedEndpoint() to get one of these, which will check once that the
+/// endpoint's type matches. After that, the cmaj::Performer methods that take a
+/// TypedEndpoint can pass data straight to the performer without needing to
+/// wrap it in a choc::value::ValueView or check its type.
+template <typename ElementType, EndpointType endpointType, uint32_t numChannels = 1>
+struct TypedEndpoint
+{
+    static_assert (std::is_same<ElementType, float>::value
+                   || std::is_same<ElementType, double>::value
+                   || std::is_same<ElementType, int32_t>::value
+                   || std::is_same<ElementType, int64_t>::value,
+                   "TypedEndpoint only supports float, double, int32_t or int64_t elements");
+
+    static_assert (numChannels != 0, "A TypedEndpoint must have at least one channel");
+
+    static_assert (endpointType == EndpointType::stream
+                   || endpointType == EndpointType::value
+                   || endpointType == EndpointType::event,
+                   "A TypedEndpoint must be a stream, value or event endpoint");
+
+    /// The type of a single frame, value or event for this endpoint. This has the
+    /// same memory layout as the equivalent Cmajor type.
+    using FrameType = typename std::conditional<numChannels == 1, ElementType, std::array<ElementType, numChannels>>::type;
+
+    /// Returns true if the handle refers to an endpoint that was found.
+    bool isValid() const                                    { return handle != EndpointHandle(); }
+
+    /// Returns true if a choc type has the layout that this class expects.
+    static bool isMatchingType (const choc::value::Type&);
+
+    /// The endpoint's handle.
+    EndpointHandle handle = {};
+    /// For an event endpoint that has several types, this is the index of the one that matches.
+    uint32_t typeIndex = 0;
+};
+
+//==============================================================================
 /** A class that acts as a wrapper around a PerformerInterface object, replacing
     its clunky COM API with nicer, idiomatic C++ methods.
 
@@ -54,6 +98,11 @@ struct Performer
     bool operator!= (decltype (nullptr)) const      { return performer; }
     bool operator== (decltype (nullptr)) const      { return ! performer; }
 
+    /// Returns true if the underlying performer implements ExtendedPerformerInterface.
+    /// The performers from the Cmajor engine library don't, in which case the methods that
+    /// need it will either fall back to using the basic PerformerInterface calls, or fail.
+    bool supportsExtendedOperations() const         { return getExtendedPerformer() != nullptr; }
+
     //==============================================================================
     /// Sets the number of frames which should be rendered during the next call to advance().
     void setBlockSize (uint32_t numFramesForNextBlock);
@@ -73,6 +122,25 @@ struct Performer
     template <typename SampleType>
     void setInputFrames (EndpointHandle, const choc::buffer::InterleavedView<SampleType>&);
 
+    /// Provides a block of non-interleaved frames to an input stream endpoint.
+    /// This takes an array of pointers, one for each channel of the endpoint's frame type, each
+    /// pointing to numFrames contiguous samples.
+    /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
+    /// It should only be called once before each advance() call.
+    /// This needs a performer that supportsExtendedOperations(), and if it doesn't, nothing is
+    /// done and it returns false.
+    bool setInputFramesFromChannelArray (EndpointHandle, const void* const* channelData,
+                                         uint32_t numChannels, uint32_t numFrames);
+
+    /// Provides a block of non-interleaved frames to an input stream endpoint.
+    /// If the performer doesn't supportsExtendedOperations(), the data is interleaved into a
+    /// temporary buffer, which will allocate.
+    /// NB: to avoid overhead in the realtime audio thread, this doesn't perform any kind of
+    /// sanity-checking to make sure that the format of data provided matches the endpoint,
+    /// so it's up to the caller to make sure you get it right!
+    template <typename SampleType>
+    void setInputFrames (EndpointHandle, const choc::buffer::ChannelArrayView<SampleType>&);
+
     /// Sets the current value for a latching input value endpoint.
     /// Before calling advance(), this can optionally be called for a value input to change its value.
     /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
@@ -102,6 +170,53 @@ struct Performer
     template <typename ValueType>
     void addInputEvent (EndpointHandle, uint32_t typeIndex, const ValueType& eventValue);
 
+    /// Adds an event to the queue for an input event endpoint, to be delivered at a given frame.
+    /// This works like the other addInputEvent() method, but instead of being invoked at the start
+    /// of the next block, the event will be dispatched when advance() reaches the given frame offset,
+    /// which must be less than the current block size. This means that a block of timestamped events
+    /// (e.g. MIDI) can be rendered with a single advance() call. The events for a block must be
+    /// added before its stream input frames are set.
+    /// If the performer doesn't supportsExtendedOperations(), only events with a frame offset of 0
+    /// can be added, and for any others this returns false without adding them.
+    template <typename ValueType>
+    bool addInputEvent (EndpointHandle, uint32_t typeIndex, uint32_t frameOffset, const ValueType& eventValue);
+
+    /// Provides a block of interleaved frames to a typed input stream endpoint.
+    /// The data must contain numFrames * numChannels elements.
+    template <typename ElementType, uint32_t numChannels>
+    void setInputFrames (const TypedEndpoint<ElementType, EndpointType::stream, numChannels>&,
+                         const ElementType* frameData, uint32_t numFrames);
+
+    /// Sets the value of a typed input value endpoint.
+    template <typename ElementType, uint32_t numChannels>
+    void setInputValue (const TypedEndpoint<ElementType, EndpointType::value, numChannels>&,
+                        const typename TypedEndpoint<ElementType, EndpointType::value, numChannels>::FrameType& newValue,
+                        uint32_t numFramesToReachValue);
+
+    /// Adds an event to the queue for a typed input event endpoint, to be delivered at the
+    /// start of the next block.
+    template <typename ElementType, uint32_t numChannels>
+    void addInputEvent (const TypedEndpoint<ElementType, EndpointType::event, numChannels>&,
+                        const typename TypedEndpoint<ElementType, EndpointType::event, numChannels>::FrameType& eventValue);
+
+    /// Adds an event to the queue for a typed input event endpoint, to be delivered at the
+    /// given frame offset within the next block. Like the untyped version, this returns false
+    /// if the frame offset isn't 0 and the performer doesn't supportsExtendedOperations().
+    template <typename ElementType, uint32_t numChannels>
+    bool addInputEvent (const TypedEndpoint<ElementType, EndpointType::event, numChannels>&, uint32_t frameOffset,
+                        const typename TypedEndpoint<ElementType, EndpointType::event, numChannels>::FrameType& eventValue);
+
+    /// Copies the frames from a typed output stream endpoint into an interleaved buffer,
+    /// which must have space for numFrames * numChannels elements.
+    template <typename ElementType, uint32_t numChannels>
+    void copyOutputFrames (const TypedEndpoint<ElementType, EndpointType::stream, numChannels>&,
+                           ElementType* dest, uint32_t numFramesToCopy) const;
+
+    /// Returns the current value of a typed output value endpoint.
+    template <typename ElementType, uint32_t numChannels>
+    typename TypedEndpoint<ElementType, EndpointType::value, numChannels>::FrameType
+        getOutputValue (const TypedEndpoint<ElementType, EndpointType::value, numChannels>&) const;
+
     /// Copies-out the frame data from an output stream endpoint.
     /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
     /// After calling advance(), this can be called to retrieve the frame data for the given endpoint.
@@ -123,6 +238,45 @@ struct Performer
     template <typename SampleType>
     void copyOutputFrames (EndpointHandle, choc::buffer::InterleavedBuffer<SampleType>& destBuffer) const;
 
+    /// Copies-out the frame data from an output stream endpoint into a set of separate channels.
+    /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
+    /// Each of the channel destinations must have space for numFramesToCopy samples of the
+    /// endpoint's element type.
+    /// This needs a performer that supportsExtendedOperations(), and if it doesn't, nothing is
+    /// done and it returns false.
+    bool copyOutputFramesToChannelArray (EndpointHandle, void* const* channelDest,
+                                         uint32_t numChannels, uint32_t numFramesToCopy) const;
+
+    /// Copies the last block of samples from a stream endpoint to a non-interleaved sample buffer.
+    /// If the performer doesn't supportsExtendedOperations(), the data is copied via a
+    /// temporary buffer, which will allocate.
+    /// NB: to avoid overhead in the realtime audio thread, this doesn't perform any kind of
+    /// sanity-checking to make sure that you're asking for the correct format of data,
+    /// so it's up to the caller to make sure you get it right!
+    template <typename SampleType>
+    void copyOutputFrames (EndpointHandle, const choc::buffer::ChannelArrayView<SampleType>& destBuffer) const;
+
+    /// Returns a read-only pointer to the performer's internal buffer for an output stream endpoint.
+    /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
+    /// After calling advance(), this lets you read the last block of frames without needing a
+    /// buffer of your own, but it isn't necessarily zero-copy, as the performer may still copy the
+    /// frames into its buffer internally.
+    /// The pointer is only valid until the next call to advance(), and will be nullptr if the
+    /// performer doesn't support this, in which case use copyOutputFrames() instead.
+    /// Performers that don't supportsExtendedOperations() (e.g. the JIT engine's) always return nullptr.
+    const void* getOutputFramesPointer (EndpointHandle) const;
+
+    /// Returns a read-only view of the last block of samples from a stream endpoint, using
+    /// getOutputFramesPointer(), so the same caveats about copying apply. The view is only valid
+    /// until the next call to advance(), and will be empty if the performer doesn't support it.
+    /// NB: to avoid overhead in the realtime audio thread, this doesn't perform any kind of
+    /// sanity-checking to make sure that you're asking for the correct format of data,
+    /// so it's up to the caller to make sure you get it right!
+    template <typename SampleType>
+    choc::buffer::InterleavedView<const SampleType> getOutputFrames (EndpointHandle,
+                                                                     choc::buffer::ChannelCount numChannels,
+                                                                     choc::buffer::FrameCount numFrames) const;
+
     /// Copies-out the data for the current value of an output value endpoint.
     /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
     /// After calling advance(), this can be called to retrieve the value data for the given endpoint.
@@ -141,10 +295,62 @@ struct Performer
     template <typename HandlerFn>
     void iterateOutputEvents (EndpointHandle, HandlerFn&&);
 
+    /// Iterates the events that were pushed into all of the output event endpoints during the
+    /// last advance() call, in frame order, so that events from several endpoints can be handled
+    /// in a single pass without needing to be sorted.
+    /// This needs a performer that supportsExtendedOperations(), and if it doesn't, it returns
+    /// false without iterating anything, and you'll need to call iterateOutputEvents() for
+    /// each endpoint instead.
+    ///
+    /// The functor provided must have the form:
+    ///  (EndpointHandle, uint32_t dataTypeIndex, uint32_t frameOffset,
+    ///   const void* valueData, uint32_t valueDataSize) -> bool
+    template <typename HandlerFn>
+    bool iterateAllOutputEvents (HandlerFn&&);
+
     /// Renders the next block.
     /// The number of frames rendered will be the number that was last specified by a call to setBlockSize().
     void advance();
 
+    /// Renders a complete block, with all its stream, event and value inputs and its stream
+    /// outputs described by a single BlockDescriptor.
+    /// This does the same job as calling setBlockSize(), the various input functions, advance()
+    /// and copyOutputFrames() separately, but avoids the cost of a call per endpoint. If the
+    /// performer doesn't supportsExtendedOperations(), it just makes those calls itself.
+    /// NB: to avoid overhead in the realtime audio thread, this doesn't perform any kind of
+    /// sanity-checking on the data formats, so it's up to the caller to make sure you get it right!
+    void process (const BlockDescriptor&);
+
+    /// Returns the number of bytes needed to hold a snapshot of the performer's internal state,
+    /// or 0 if the performer doesn't support saving and restoring its state (which will always be
+    /// the case if it doesn't supportsExtendedOperations()).
+    size_t getStateSize() const;
+
+    /// Writes a snapshot of the performer's complete internal state into a buffer which must
+    /// be at least getStateSize() bytes. This must only be called between blocks.
+    /// Returns false if the performer can't save its state.
+    bool saveState (void* dest) const;
+
+    /// Returns a snapshot of the performer's complete internal state, or an empty vector if
+    /// the performer can't save its state. This must only be called between blocks.
+    std::vector<uint8_t> saveState() const;
+
+    /// Restores a state that was previously saved from this performer, or from another performer
+    /// created by the same linked program. This must only be called between blocks.
+    /// Returns false if the performer can't restore its state.
+    bool restoreState (const void* source);
+
+    /// Restores a state that was returned by saveState(). Returns false if the size of the
+    /// data doesn't match, or if the performer can't restore its state.
+    bool restoreState (const std::vector<uint8_t>& state);
+
+    /// Returns a new, independent performer whose internal state is a copy of this one.
+    /// Cloning a prototype is much cheaper than calling Engine::createPerformer() when you need
+    /// lots of instances of the same program, because the clone's state is copied rather than
+    /// initialised from scratch. This must only be called between blocks.
+    /// Returns a null Performer if the underlying performer doesn't support cloning.
+    Performer clone() const;
+
     /// Retrieves the string from a handle used in the current program, or an empty string if not found.
     std::string_view getStringForHandle (uint32_t handle) const;
 
@@ -167,10 +373,21 @@ struct Performer
 
     //==============================================================================
     /// The underlying performer that this helper object is wrapping.
+    /// If this is replaced, the extended interface is re-queried from the new
+    /// performer the next time it's needed.
     PerformerPtr performer;
 
 private:
     Library::SharedLibraryPtr library;
+    // The query takes a lock, so the result is kept, and only re-queried if the
+    // performer member has been changed since then
+    mutable PerformerInterface* queriedPerformer = nullptr;
+    mutable ExtendedPerformerInterface* extendedPerformer = nullptr;
+
+    ExtendedPerformerInterface* getExtendedPerformer() const;
+
+    template <typename ValueType, typename HandlerFn>
+    static void withRawEventData (const ValueType&, HandlerFn&&);
 };
 
 
@@ -186,7 +403,40 @@ private:
 //
 //==============================================================================
 
-inline Performer::Performer (PerformerPtr p) : performer (p), library (Library::getSharedLibraryPtr()) {}
+template <typename ElementType, EndpointType endpointType, uint32_t numChannels>
+bool TypedEndpoint<ElementType, endpointType, numChannels>::isMatchingType (const choc::value::Type& type)
+{
+    auto isMatchingElement = [] (const choc::value::Type& t)
+    {
+        if constexpr (std::is_same<ElementType, float>::value)         return t.isFloat32();
+        else if constexpr (std::is_same<ElementType, double>::value)   return t.isFloat64();
+        else if constexpr (std::is_same<ElementType, int32_t>::value)  return t.isInt32();
+        else                                                           return t.isInt64();
+    };
+
+    if constexpr (numChannels == 1)
+        return isMatchingElement (type);
+    else
+        return type.isVector() && type.getNumElements() == numChannels && isMatchingElement (type.getElementType());
+}
+
+inline Performer::Performer (PerformerPtr p)
+    : performer (p), library (Library::getSharedLibraryPtr()),
+      queriedPerformer (p.get()),
+      extendedPerformer (ExtendedPerformerInterface::query (p.get()))
+{
+}
+
+inline ExtendedPerformerInterface* Performer::getExtendedPerformer() const
+{
+    if (performer.get() != queriedPerformer)
+    {
+        queriedPerformer = performer.get();
+        extendedPerformer = ExtendedPerformerInterface::query (queriedPerformer);
+    }
+
+    return extendedPerformer;
+}
 
 inline Performer::~Performer()
 {
@@ -210,6 +460,40 @@ void Performer::setInputFrames (EndpointHandle endpoint, const choc::buffer::Int
     performer->setInputFrames (endpoint, buffer.data.data, buffer.getNumFrames());
 }
 
+inline bool Performer::setInputFramesFromChannelArray (EndpointHandle endpoint, const void* const* channelData,
+                                                       uint32_t numChannels, uint32_t numFrames)
+{
+    auto extended = getExtendedPerformer();
+
+    if (extended == nullptr)
+        return false;
+
+    extended->setInputFramesFromChannelArray (endpoint, channelData, numChannels, numFrames);
+    return true;
+}
+
+template <typename SampleType>
+void Performer::setInputFrames (EndpointHandle endpoint, const choc::buffer::ChannelArrayView<SampleType>& buffer)
+{
+    auto numChannels = buffer.getNumChannels();
+    auto extended = getExtendedPerformer();
+
+    if (extended == nullptr)
+    {
+        choc::buffer::InterleavedBuffer<typename std::remove_const<SampleType>::type> interleaved (numChannels, buffer.getNumFrames());
+        copy (interleaved.getView(), buffer);
+        performer->setInputFrames (endpoint, interleaved.getView().data.data, buffer.getNumFrames());
+        return;
+    }
+
+    choc::SmallVector<const void*, 16> channels;
+
+    for (uint32_t i = 0; i < numChannels; ++i)
+        channels.push_back (buffer.getChannel (i).data.data);
+
+    extended->setInputFramesFromChannelArray (endpoint, channels.data(), numChannels, buffer.getNumFrames());
+}
+
 template <typename ValueType>
 void Performer::setInputValue (EndpointHandle e, const ValueType& newValue, uint32_t numFramesToReachValue)
 {
@@ -252,6 +536,25 @@ void Performer::setInputValue (EndpointHandle e, const ValueType& newValue, uint
 
 template <typename ValueType>
 void Performer::addInputEvent (EndpointHandle e, uint32_t type, const ValueType& value)
+{
+    withRawEventData (value, [&] (const void* data) { performer->addInputEvent (e, type, data); });
+}
+
+template <typename ValueType>
+bool Performer::addInputEvent (EndpointHandle e, uint32_t type, uint32_t frameOffset, const ValueType& value)
+{
+    if (auto extended = getExtendedPerformer())
+        withRawEventData (value, [&] (const void* data) { extended->addTimestampedInputEvent (e, type, frameOffset, data); });
+    else if (frameOffset == 0)
+        withRawEventData (value, [&] (const void* data) { performer->addInputEvent (e, type, data); });
+    else
+        return false;
+
+    return true;
+}
+
+template <typename ValueType, typename HandlerFn>
+void Performer::withRawEventData (const ValueType& value, HandlerFn&& handler)
 {
     static_assert (std::is_same<const ValueType, const int32_t>::value
                    || std::is_same<const ValueType, const int64_t>::value
@@ -270,25 +573,77 @@ void Performer::addInputEvent (EndpointHandle e, uint32_t type, const ValueType&
                    || std::is_same<const ValueType, const double>::value)
     {
         ValueType v = value;
-        performer->addInputEvent (e, type, std::addressof (v));
+        handler (std::addressof (v));
     }
     else if constexpr (std::is_same<const ValueType, const void* const>::value
                         || std::is_same<const ValueType, const char* const>::value)
     {
-        performer->addInputEvent (e, type, value);
+        handler (value);
     }
     else if constexpr (std::is_same<const ValueType, const bool>::value)
     {
         int32_t v = value ? 1 : 0;
-        performer->addInputEvent (e, type, std::addressof (v));
+        handler (std::addressof (v));
     }
     else if constexpr (std::is_same<const ValueType, const choc::value::ValueView>::value
                         || std::is_same<const ValueType, const choc::value::Value>::value)
     {
-        performer->addInputEvent (e, type, value.getRawData());
+        handler (value.getRawData());
     }
 }
 
+template <typename ElementType, uint32_t numChannels>
+void Performer::setInputFrames (const TypedEndpoint<ElementType, EndpointType::stream, numChannels>& endpoint,
+                                const ElementType* frameData, uint32_t numFrames)
+{
+    performer->setInputFrames (endpoint.handle, frameData, numFrames);
+}
+
+template <typename ElementType, uint32_t numChannels>
+void Performer::setInputValue (const TypedEndpoint<ElementType, EndpointType::value, numChannels>& endpoint,
+                               const typename TypedEndpoint<ElementType, EndpointType::value, numChannels>::FrameType& newValue,
+                               uint32_t numFramesToReachValue)
+{
+    performer->setInputValue (endpoint.handle, std::addressof (newValue), numFramesToReachValue);
+}
+
+template <typename ElementType, uint32_t numChannels>
+void Performer::addInputEvent (const TypedEndpoint<ElementType, EndpointType::event, numChannels>& endpoint,
+                               const typename TypedEndpoint<ElementType, EndpointType::event, numChannels>::FrameType& eventValue)
+{
+    performer->addInputEvent (endpoint.handle, endpoint.typeIndex, std::addressof (eventValue));
+}
+
+template <typename ElementType, uint32_t numChannels>
+bool Performer::addInputEvent (const TypedEndpoint<ElementType, EndpointType::event, numChannels>& endpoint, uint32_t frameOffset,
+                               const typename TypedEndpoint<ElementType, EndpointType::event, numChannels>::FrameType& eventValue)
+{
+    if (auto extended = getExtendedPerformer())
+        extended->addTimestampedInputEvent (endpoint.handle, endpoint.typeIndex, frameOffset, std::addressof (eventValue));
+    else if (frameOffset == 0)
+        performer->addInputEvent (endpoint.handle, endpoint.typeIndex, std::addressof (eventValue));
+    else
+        return false;
+
+    return true;
+}
+
+template <typename ElementType, uint32_t numChannels>
+void Performer::copyOutputFrames (const TypedEndpoint<ElementType, EndpointType::stream, numChannels>& endpoint,
+                                  ElementType* dest, uint32_t numFramesToCopy) const
+{
+    performer->copyOutputFrames (endpoint.handle, dest, numFramesToCopy);
+}
+
+template <typename ElementType, uint32_t numChannels>
+typename TypedEndpoint<ElementType, EndpointType::value, numChannels>::FrameType
+    Performer::getOutputValue (const TypedEndpoint<ElementType, EndpointType::value, numChannels>& endpoint) const
+{
+    typename TypedEndpoint<ElementType, EndpointType::value, numChannels>::FrameType result;
+    performer->copyOutputValue (endpoint.handle, std::addressof (result));
+    return result;
+}
+
 inline void Performer::copyOutputValue (EndpointHandle endpoint, void* dest) const
 {
     performer->copyOutputValue (endpoint, dest);
@@ -311,6 +666,57 @@ void Performer::copyOutputFrames (EndpointHandle endpoint, choc::buffer::Interle
     performer->copyOutputFrames (endpoint, destBuffer.getView().data.data, destBuffer.getNumFrames());
 }
 
+inline bool Performer::copyOutputFramesToChannelArray (EndpointHandle endpoint, void* const* channelDest,
+                                                       uint32_t numChannels, uint32_t numFramesToCopy) const
+{
+    auto extended = getExtendedPerformer();
+
+    if (extended == nullptr)
+        return false;
+
+    extended->copyOutputFramesToChannelArray (endpoint, channelDest, numChannels, numFramesToCopy);
+    return true;
+}
+
+template <typename SampleType>
+void Performer::copyOutputFrames (EndpointHandle endpoint, const choc::buffer::ChannelArrayView<SampleType>& destBuffer) const
+{
+    auto numChannels = destBuffer.getNumChannels();
+    auto extended = getExtendedPerformer();
+
+    if (extended == nullptr)
+    {
+        choc::buffer::InterleavedBuffer<SampleType> interleaved (numChannels, destBuffer.getNumFrames());
+        performer->copyOutputFrames (endpoint, interleaved.getView().data.data, destBuffer.getNumFrames());
+        copy (destBuffer, interleaved.getView());
+        return;
+    }
+
+    choc::SmallVector<void*, 16> channels;
+
+    for (uint32_t i = 0; i < numChannels; ++i)
+        channels.push_back (destBuffer.getChannel (i).data.data);
+
+    extended->copyOutputFramesToChannelArray (endpoint, channels.data(), numChannels, destBuffer.getNumFrames());
+}
+
+inline const void* Performer::getOutputFramesPointer (EndpointHandle endpoint) const
+{
+    auto extended = getExtendedPerformer();
+    return extended != nullptr ? extended->getOutputFramesPointer (endpoint) : nullptr;
+}
+
+template <typename SampleType>
+choc::buffer::InterleavedView<const SampleType> Performer::getOutputFrames (EndpointHandle endpoint,
+                                                                            choc::buffer::ChannelCount numChannels,
+                                                                            choc::buffer::FrameCount numFrames) const
+{
+    if (auto data = getOutputFramesPointer (endpoint))
+        return choc::buffer::createInterleavedView (static_cast<const SampleType*> (data), numChannels, numFrames);
+
+    return {};
+}
+
 template <typename HandlerFn>
 inline void Performer::iterateOutputEvents (EndpointHandle endpoint, HandlerFn&& handler)
 {
@@ -319,7 +725,7 @@ inline void Performer::iterateOutputEvents (EndpointHandle endpoint, HandlerFn&&
         static bool handleEvent (void* context, EndpointHandle handle, uint32_t dataTypeIndex,
                                  uint32_t frameOffset, const void* valueData, uint32_t valueDataSize)
         {
-            auto h = static_cast<HandlerFn*> (context);
+            auto h = static_cast<std::remove_reference_t<HandlerFn>*> (context);
             return (*h) (handle, dataTypeIndex, frameOffset, valueData, valueDataSize);
         }
     };
@@ -327,11 +733,100 @@ inline void Performer::iterateOutputEvents (EndpointHandle endpoint, HandlerFn&&
     performer->iterateOutputEvents (endpoint, std::addressof (handler), Callback::handleEvent);
 }
 
+template <typename HandlerFn>
+inline bool Performer::iterateAllOutputEvents (HandlerFn&& handler)
+{
+    auto extended = getExtendedPerformer();
+
+    if (extended == nullptr)
+        return false;
+
+    struct Callback
+    {
+        static bool handleEvent (void* context, EndpointHandle handle, uint32_t dataTypeIndex,
+                                 uint32_t frameOffset, const void* valueData, uint32_t valueDataSize)
+        {
+            auto h = static_cast<std::remove_reference_t<HandlerFn>*> (context);
+            return (*h) (handle, dataTypeIndex, frameOffset, valueData, valueDataSize);
+        }
+    };
+
+    extended->iterateAllOutputEvents (std::addressof (handler), Callback::handleEvent);
+    return true;
+}
+
 inline void Performer::advance()
 {
     performer->advance();
 }
 
+inline void Performer::process (const BlockDescriptor& block)
+{
+    if (auto extended = getExtendedPerformer())
+        return extended->process (block);
+
+    performer->setBlockSize (block.numFrames);
+
+    for (uint32_t i = 0; i < block.numStreamInputs; ++i)
+        performer->setInputFrames (block.streamInputs[i].endpoint, block.streamInputs[i].frameData, block.numFrames);
+
+    for (uint32_t i = 0; i < block.numEventInputs; ++i)
+        performer->addInputEvent (block.eventInputs[i].endpoint, block.eventInputs[i].typeIndex, block.eventInputs[i].eventData);
+
+    for (uint32_t i = 0; i < block.numValueInputs; ++i)
+        performer->setInputValue (block.valueInputs[i].endpoint, block.valueInputs[i].valueData, block.valueInputs[i].numFramesToReachValue);
+
+    performer->advance();
+
+    for (uint32_t i = 0; i < block.numStreamOutputs; ++i)
+        performer->copyOutputFrames (block.streamOutputs[i].endpoint, block.streamOutputs[i].destData, block.numFrames);
+}
+
+inline size_t Performer::getStateSize() const
+{
+    auto extended = getExtendedPerformer();
+    return extended != nullptr ? extended->getStateSize() : 0;
+}
+
+inline bool Performer::saveState (void* dest) const
+{
+    auto extended = getExtendedPerformer();
+    return extended != nullptr && extended->saveState (dest);
+}
+
+inline std::vector<uint8_t> Performer::saveState() const
+{
+    std::vector<uint8_t> state (getStateSize());
+
+    if (state.empty() || ! saveState (state.data()))
+        return {};
+
+    return state;
+}
+
+inline bool Performer::restoreState (const void* source)
+{
+    auto extended = getExtendedPerformer();
+    return extended != nullptr && extended->restoreState (source);
+}
+
+inline bool Performer::restoreState (const std::vector<uint8_t>& state)
+{
+    if (state.empty() || state.size() != getStateSize())
+        return false;
+
+    return restoreState (state.data());
+}
+
+inline Performer Performer::clone() const
+{
+    if (auto extended = getExtendedPerformer())
+        if (auto p = PerformerPtr (extended->clone()))
+            return Performer (p);
+
+    return {};
+}
+
 inline std::string_view Performer::getStringForHandle (uint32_t handle) const
 {
     size_t length;
@@ -27,6 +27,26 @@
 namespace cmaj
 {
 
+//==============================================================================
+/**
+    A COM object representing a read-only block of cached data which a
+    CacheDatabaseInterface has mapped into memory.
+
+    The data stays valid until the object is released, and releasing it
+    unmaps the data.
+*/
+struct CacheDatabaseMappedRegion   : public choc::com::Object
+{
+    /// Returns the start of the mapped data.
+    virtual const void* getData() = 0;
+
+    /// Returns the number of bytes of mapped data.
+    virtual uint64_t getSize() = 0;
+
+    /// handy smart-pointer type for handling these objects
+    using Ptr = choc::com::Ptr<CacheDatabaseMappedRegion>;
+};
+
 //==============================================================================
 /**
     A COM base class for implementing a database of cached binary objects that the
@@ -47,6 +67,13 @@ struct CacheDatabaseInterface   : public choc::com::Object
     /// in the database.
     virtual uint64_t reload (const char* key, void* destAddress, uint64_t destSize) = 0;
 
+    /// Optionally, a cache can provide direct read-only access to an entry without
+    /// copying it, e.g. by memory-mapping the file that holds it.
+    /// If the key is found, this returns a region object which the caller must release when
+    /// it has finished with the data. If the key isn't found, or the cache doesn't support
+    /// this, it returns nullptr, and the caller should fall back to using reload().
+    [[nodiscard]] virtual CacheDatabaseMappedRegion* reloadMapped (const char* /*key*/)   { return nullptr; }
+
     /// handy smart-pointer type for handling these objects
     using Ptr = choc::com::Ptr<CacheDatabaseInterface>;
 };
@@ -0,0 +1,247 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <mutex>
+#include <unordered_set>
+#include "cmaj_PerformerInterface.h"
+
+
+namespace cmaj
+{
+
+//==============================================================================
+/// Describes all the inputs and outputs needed to render a single block, so that
+/// ExtendedPerformerInterface::process() can do the whole job in one call.
+///
+/// All the arrays and data pointers are owned by the caller, and only need to
+/// remain valid for the duration of the process() call.
+struct BlockDescriptor
+{
+    /// A chunk of frames for an input stream. The data must contain numFrames
+    /// frames in the endpoint's frame format.
+    struct StreamInput
+    {
+        EndpointHandle endpoint;
+        const void* frameData;
+    };
+
+    /// An event to add to the queue for an input event endpoint.
+    struct EventInput
+    {
+        EndpointHandle endpoint;
+        uint32_t typeIndex;
+        const void* eventData;
+    };
+
+    /// A new value for an input value endpoint.
+    struct ValueInput
+    {
+        EndpointHandle endpoint;
+        const void* valueData;
+        uint32_t numFramesToReachValue;
+    };
+
+    /// A destination for the frames of an output stream. The buffer must have
+    /// space for numFrames frames in the endpoint's frame format.
+    struct StreamOutput
+    {
+        EndpointHandle endpoint;
+        void* destData;
+    };
+
+    uint32_t numFrames = 0;
+
+    const StreamInput* streamInputs = nullptr;
+    uint32_t numStreamInputs = 0;
+
+    const EventInput* eventInputs = nullptr;
+    uint32_t numEventInputs = 0;
+
+    const ValueInput* valueInputs = nullptr;
+    uint32_t numValueInputs = 0;
+
+    const StreamOutput* streamOutputs = nullptr;
+    uint32_t numStreamOutputs = 0;
+};
+
+
+//==============================================================================
+/**
+    An optional extension to PerformerInterface, adding some extra operations.
+
+    The performers in the Cmajor engine library don't implement this, and the layout
+    of PerformerInterface itself has to stay the same so that they can still be
+    loaded, so these operations live in a separate interface. Performers that are
+    created by in-process helpers such as GeneratedCppEngine derive from this class,
+    and query() can be used to find out whether a given performer supports it.
+
+    Note that the cmaj::Performer class wraps all of this up, and falls back to the
+    basic PerformerInterface methods where it can, so you'll rarely need to use
+    this class directly.
+*/
+struct ExtendedPerformerInterface   : public PerformerInterface
+{
+    ExtendedPerformerInterface()                                    { getRegistry().add (this); }
+    ExtendedPerformerInterface (const ExtendedPerformerInterface&)  { getRegistry().add (this); }
+    ~ExtendedPerformerInterface() override                          { getRegistry().remove (this); }
+
+    /// If the performer implements ExtendedPerformerInterface, this returns it, or
+    /// nullptr if it only supports the basic PerformerInterface methods.
+    /// This takes a lock, so avoid calling it on a realtime thread.
+    static ExtendedPerformerInterface* query (PerformerInterface*);
+
+    /// A performer which wraps another one (e.g. a proxy) can only support these operations
+    /// if the one it wraps does too, so it can override this to return false if not, and
+    /// query() will then treat it as a basic PerformerInterface.
+    virtual bool isExtendedInterfaceAvailable()     { return true; }
+
+    //==============================================================================
+    /// Provides a block of non-interleaved frames to an input stream endpoint.
+    /// This does the same job as setInputFrames(), but instead of a single block of interleaved
+    /// frames, it takes an array of pointers, one for each channel of the endpoint's frame type.
+    /// Each channel pointer must point to numFrames contiguous samples of the frame's element type,
+    /// and numChannels must match the number of elements in the frame (or 1 for a scalar stream).
+    virtual void setInputFramesFromChannelArray (EndpointHandle endpoint, const void* const* channelData,
+                                                 uint32_t numChannels, uint32_t numFrames) = 0;
+
+    /// Adds an event to the queue for an input event endpoint, to be delivered at a particular frame.
+    /// This works like addInputEvent(), but rather than being invoked at the start of the block, the
+    /// event will be dispatched when the next call to advance() reaches the given frame offset, which
+    /// must be less than the current block size. Events with the same frame offset are delivered in
+    /// the order they were added.
+    /// This lets a caller pass a whole block of timestamped events (e.g. MIDI) to a single advance()
+    /// call rather than splitting the block at each event.
+    /// A block's timestamped events must be added before its stream input frames are set, because
+    /// a performer may only keep a copy of the input frames if it knows the block will be split.
+    /// If an event arrives too late for that, a performer may deliver it at the start of the block,
+    /// in which case it will count it as an xrun (see getXRuns()).
+    /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
+    virtual void addTimestampedInputEvent (EndpointHandle endpoint, uint32_t typeIndex,
+                                           uint32_t frameOffset, const void* eventData) = 0;
+
+    /// Copies out the data from an output stream endpoint in non-interleaved form.
+    /// This does the same job as copyOutputFrames(), but writes each channel of the endpoint's
+    /// frame type into a separate destination. Each destination must have space for
+    /// numFramesToCopy samples of the frame's element type, and numChannels must match the number
+    /// of elements in the frame (or 1 for a scalar stream).
+    virtual void copyOutputFramesToChannelArray (EndpointHandle, void* const* channelDest,
+                                                 uint32_t numChannels, uint32_t numFramesToCopy) = 0;
+
+    /// Returns a read-only pointer to a buffer, owned by the performer, which holds the frames
+    /// for an output stream endpoint.
+    /// The handle must have been obtained by calling getEndpointHandle() before the program is linked.
+    /// After calling advance(), this can be used to read the frames that were rendered, in the same
+    /// layout that copyOutputFrames() would produce, and the pointer only remains valid until the next
+    /// call to advance().
+    /// Note that this isn't necessarily zero-copy: a performer may have to copy the frames into its
+    /// buffer when this is called, so it saves the caller from needing a buffer of its own, but not
+    /// always from the cost of a copy. A performer which can't provide a buffer will return nullptr,
+    /// in which case the caller should fall back to using copyOutputFrames().
+    virtual const void* getOutputFramesPointer (EndpointHandle) = 0;
+
+    /// Iterates the events that were pushed into all of the output event endpoints during the last
+    /// advance() call, in order of their frame offsets.
+    /// This does the same job as calling iterateOutputEvents() for every output event endpoint and
+    /// then sorting the results, but in a single call. Events with the same frame offset are ordered
+    /// by the order in which the endpoints are declared, and then by the order they were emitted.
+    /// The callback is passed the handle of the endpoint that each event came from.
+    virtual void iterateAllOutputEvents (void* context, HandleOutputEventCallback) = 0;
+
+    /// Renders a complete block, including all of its input and output, in a single call.
+    /// This is equivalent to calling setBlockSize(), then setInputFrames(), addInputEvent() and
+    /// setInputValue() for each of the inputs in the descriptor, then advance(), and finally
+    /// copyOutputFrames() for each of the stream outputs, but avoids the overhead of making a
+    /// separate call for every endpoint.
+    /// Output events and values can be fetched in the normal way after this call returns.
+    virtual void process (const BlockDescriptor&) = 0;
+
+    /// Returns the number of bytes needed to hold a snapshot of the performer's internal state,
+    /// or 0 if this performer doesn't support saving and restoring its state.
+    virtual size_t getStateSize() = 0;
+
+    /// Writes a snapshot of the performer's complete internal state (e.g. delay lines, filter
+    /// and voice states) into the given buffer, which must be at least getStateSize() bytes.
+    /// This must be called between blocks, not while the performer is inside advance().
+    /// Returns false if the performer can't save its state.
+    virtual bool saveState (void* dest) = 0;
+
+    /// Restores a state that was previously written by saveState(). The data may come from
+    /// a different performer instance, as long as it was created by the same linked program.
+    /// This must be called between blocks, not while the performer is inside advance().
+    /// Returns false if the performer can't restore its state.
+    virtual bool restoreState (const void* source) = 0;
+
+    /// Creates a new performer whose internal state is a copy of this one.
+    /// This is a much cheaper way to create many instances of the same program than asking the
+    /// engine for new ones, because the new performer's state is copied from this one rather
+    /// than being built by running the program's initialisation. If the prototype hasn't yet
+    /// rendered anything, the clone starts in the same state as a freshly-created performer.
+    /// This must be called between blocks. Returns nullptr if the performer can't be cloned.
+    [[nodiscard]] virtual PerformerInterface* clone() = 0;
+
+private:
+    //==============================================================================
+    // There's no way to ask a COM object which interfaces it supports, so instead,
+    // every ExtendedPerformerInterface adds itself to this set while it exists.
+    struct Registry
+    {
+        void add (PerformerInterface* p)
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            performers.insert (p);
+        }
+
+        void remove (PerformerInterface* p)
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            performers.erase (p);
+        }
+
+        bool contains (PerformerInterface* p)
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            return performers.find (p) != performers.end();
+        }
+
+        std::mutex lock;
+        std::unordered_set<PerformerInterface*> performers;
+    };
+
+    static Registry& getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+};
+
+inline ExtendedPerformerInterface* ExtendedPerformerInterface::query (PerformerInterface* p)
+{
+    if (p != nullptr && getRegistry().contains (p))
+        if (auto e = static_cast<ExtendedPerformerInterface*> (p); e->isExtendedInterfaceAvailable())
+            return e;
+
+    return nullptr;
+}
+
+} // namespace cmaj
@@ -22,6 +22,11 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <cstddef>
 
 #include "../../choc/memory/choc_Endianness.h"
 #include "../../choc/containers/choc_VariableSizeFIFO.h"
@@ -32,6 +37,7 @@
 #include "../../choc/audio/choc_AudioMIDIBlockDispatcher.h"
 
 #include "cmaj_EndpointTypeCoercion.h"
+#include "cmaj_DurationHistogram.h"
 
 
 namespace cmaj
@@ -83,6 +89,12 @@ struct AudioMIDIPerformer
         /// a call to handlePendingOutputEvents() either synchronously or asynchronously.
         bool setEventOutputHandler (OutputEventsReadyFn);
 
+        /// If enabled, processWithTimeStampedMIDI() will give each incoming MIDI message to the
+        /// performer along with its frame offset, so that it can render the whole block in one
+        /// go, rather than chopping the block into sub-blocks at every message's timestamp.
+        /// This has no effect if the performer doesn't support timestamped events.
+        void setTimestampedMIDIInputEnabled (bool);
+
         /// Note that after creating the performer, this builder object can no longer
         /// be used - to create more performers, use new instances of the Builder
         std::unique_ptr<AudioMIDIPerformer> createPerformer();
@@ -109,6 +121,23 @@ struct AudioMIDIPerformer
     bool postValue (const cmaj::EndpointID& endpointID, const choc::value::ValueView& value, uint32_t framesToReachValue);
     bool postValue (cmaj::EndpointHandle endpointHandle, const choc::value::ValueView& value, uint32_t framesToReachValue);
 
+    /// These work like postEvent() and postValue(), but rather than being applied at the start
+    /// of the next block, the event or value change happens at the given frame. The frame is an
+    /// absolute position on the timeline returned by getNumFramesProcessed(), so the result is
+    /// the same whatever size of blocks the host uses. Events are given to the performer with
+    /// their frame offsets, and a block is only split at frames where a value changes (or at
+    /// every event, if the performer doesn't support timestamped events).
+    /// Anything that arrives too late for its frame is applied at the start of the next block.
+    bool postEventAtFrame (const cmaj::EndpointID&, const choc::value::ValueView&, uint64_t frame);
+    bool postEventAtFrame (cmaj::EndpointHandle, const choc::value::ValueView&, uint64_t frame);
+    bool postValueAtFrame (const cmaj::EndpointID&, const choc::value::ValueView&, uint32_t framesToReachValue, uint64_t frame);
+    bool postValueAtFrame (cmaj::EndpointHandle, const choc::value::ValueView&, uint32_t framesToReachValue, uint64_t frame);
+
+    /// Returns the total number of frames that have been rendered so far. This can be called
+    /// from any thread. To post something at an offset into the next block from within the
+    /// audio callback, add the offset to this value.
+    uint64_t getNumFramesProcessed() const;
+
     //==============================================================================
     /// This should be called after calling the connect functions to set up the routing,
     /// and before beginning calls to process()
@@ -116,10 +145,14 @@ struct AudioMIDIPerformer
 
     /// If 'replace' is true, it overwrites the output buffer and clears any channels that
     /// aren't in use. If false, it will add the output to whatever is already in the buffer.
+    /// Blocks which are longer than the maximum block size in the engine's BuildSettings
+    /// (or the performer's own limit, if that's smaller) are rendered in several chunks.
     bool process (const choc::audio::AudioMIDIBlockDispatcher::Block&, bool replaceOutput);
 
     /// This version of process will automatically chop up a set of MIDI events with frame
-    /// times into sub-blocks, and process each chunk separately
+    /// times into sub-blocks, and process each chunk separately. If the builder enabled
+    /// timestamped MIDI input, the events are passed to the performer with their frame
+    /// offsets instead, and the block is only split if it exceeds the maximum block size.
     bool processWithTimeStampedMIDI (const choc::buffer::ChannelArrayView<const float> audioInput,
                                      const choc::buffer::ChannelArrayView<float> audioOutput,
                                      const choc::midi::ShortMessage* midiInMessages,
@@ -135,6 +168,40 @@ struct AudioMIDIPerformer
     /// It's safe to call this from any thread.
     void handlePendingOutputEvents (OutputEventHandlerFn&&);
 
+    //==============================================================================
+    /// A snapshot of the statistics that are gathered about how long each call to
+    /// the performer's advance() method takes.
+    struct AdvanceTimingStats
+    {
+        struct BlockSizeBucket
+        {
+            uint32_t minFrames = 0, maxFrames = 0;
+            uint64_t numBlocks = 0, numDeadlineMisses = 0;
+            double totalSeconds = 0;
+        };
+
+        uint64_t numBlocks = 0;
+        /// The number of blocks whose advance() call took longer than the real-time
+        /// duration of the block
+        uint64_t numDeadlineMisses = 0;
+        double minSeconds = 0, maxSeconds = 0;
+        /// Percentiles are estimated from a histogram which has four buckets per octave
+        double p50Seconds = 0, p99Seconds = 0, p999Seconds = 0;
+        /// Blocks are grouped into power-of-two ranges of block size
+        std::vector<BlockSizeBucket> blockSizeBuckets;
+
+        choc::value::Value toValue() const;
+    };
+
+    /// Returns the timing statistics that have been gathered since the performer started
+    /// or since resetAdvanceTimingStats() was last called.
+    /// This is lock-free and can be called from any thread without blocking the audio thread,
+    /// although the values it reads may be from slightly different blocks.
+    AdvanceTimingStats getAdvanceTimingStats() const;
+
+    /// Asks the audio thread to clear the timing statistics at the start of its next block.
+    void resetAdvanceTimingStats();
+
     cmaj::Engine engine;
     cmaj::Performer performer;
 
@@ -142,29 +209,137 @@ private:
     //==============================================================================
     EndpointTypeCoercionHelperList endpointTypeCoercionHelpers;
 
-    std::vector<std::function<void(const choc::audio::AudioMIDIBlockDispatcher::Block&)>> preRenderFunctions,
-                                                                                          postRenderReplaceFunctions,
-                                                                                          postRenderAddFunctions;
+    //==============================================================================
+    // The Builder compiles the audio routing into flat lists of these simple operations,
+    // which are run through in a single loop for each block.
+    struct ChannelMapping
+    {
+        uint32_t source, dest;
+        bool addToDest;
+    };
+
+    struct RoutingOp
+    {
+        enum class Type : uint8_t
+        {
+            setInputFramesDirect,       // pass the host's input channels straight to the endpoint
+            setInputFramesInterleaved,  // interleave the input channels into the scratch buffer first
+            clearOutputChannel,         // clear the output channel given by the first mapping's dest
+            clearOutputChannelsFrom,    // clear all the output channels from the first mapping's dest upwards
+            copyOutputDirect,           // the performer writes straight into the output channels
+            copyOutputMono,             // write a mono endpoint into one channel, and copy it to any others
+            copyOutputViaScratch,       // read the endpoint's frames, then copy or add them to the outputs
+            addOutputViaScratch,        // read the endpoint's frames, then add them to the outputs
+            readOutputForListener       // read the endpoint's frames just to pass them to the listener
+        };
+
+        Type type;
+        bool isFloat64;
+        EndpointHandle endpoint;
+        uint32_t numEndpointChannels;
+        uint32_t firstMapping, numMappings;   // a range within routingChannelMappings
+        AudioDataListener* listener;
+    };
+
+    std::vector<RoutingOp> inputRoutingOps, replaceOutputRoutingOps, addOutputRoutingOps;
+    std::vector<ChannelMapping> routingChannelMappings;
+    std::vector<void*> routingChannelPointers;
+    std::vector<std::shared_ptr<AudioDataListener>> routingListeners;
+
     std::vector<cmaj::EndpointHandle> midiInputEndpoints, midiOutputEndpoints;
+    std::vector<std::pair<choc::midi::ShortMessage, uint32_t>> midiOutputMessages;
     std::vector<std::pair<cmaj::EndpointHandle, std::string>> eventOutputHandles;
     std::unordered_map<std::string, EndpointHandle> inputEndpointHandles;
-    choc::fifo::VariableSizeFIFO eventQueue, valueQueue, outputEventQueue;
+    choc::fifo::VariableSizeFIFO eventQueue, valueQueue, timedInputQueue, outputEventQueue;
     OutputEventsReadyFn outputEventsReadyHandler;
-    std::vector<std::pair<choc::midi::ShortMessage, uint32_t>> midiOutputMessages;
     choc::buffer::InterleavingScratchBuffer<float> audioInputScratchBuffer;
     std::vector<uint8_t> audioOutputScratchSpace;
 
-    uint64_t numFramesProcessed = 0;
-    static constexpr uint32_t maxFramesPerBlock = 512;
+    //==============================================================================
+    // Timestamped events and values are moved from the FIFO into this list, which is kept
+    // sorted by frame. Its storage is preallocated so that the audio thread never allocates.
+    struct TimedInput
+    {
+        uint64_t frame;
+        EndpointHandle endpoint;
+        uint32_t typeIndexOrFramesToReachValue;
+        uint32_t dataOffset, dataSize;   // a range within pendingTimedInputData
+        bool isValue;
+    };
+
+    static constexpr uint32_t timedInputHeaderSize = sizeof (EndpointHandle) + sizeof (uint32_t) + sizeof (uint64_t) + 1;
+
+    // Each item's data starts at an offset with the same alignment as the heap block that
+    // holds it, so that the performer can read it as a typed value
+    static constexpr uint32_t timedInputDataAlignment = alignof (std::max_align_t);
+
+    std::vector<TimedInput> pendingTimedInputs;
+    std::vector<char> pendingTimedInputData, pendingTimedInputScratch;
+    uint32_t maxTimedInputDataInFIFO = 0, maxTimedInputsInFIFO = 0;
+
+    static uint32_t appendTimedInputData (std::vector<char>&, const char* data, uint32_t size);
+
+    std::atomic<uint64_t> numFramesProcessed { 0 };
+    /// The largest chunk that will be passed to the performer in one advance() call.
+    /// This comes from the engine's build settings, and the scratch buffers are sized to match.
+    uint32_t maxFramesPerBlock = 0;
     uint32_t currentMaxBlockSize = 0;
+    bool timestampedMIDIInput = false;
 
     //==============================================================================
     // To create an AudioMIDIPerformer, use a Builder object
     AudioMIDIPerformer (cmaj::Engine, uint32_t eventFIFOSize);
 
     void allocateScratch();
-    void dispatchMIDIOutputEvents (const choc::audio::AudioMIDIBlockDispatcher::Block&);
-    void moveOutputEventsToQueue();
+
+    bool processBlock (const choc::audio::AudioMIDIBlockDispatcher::Block&, bool replaceOutput,
+                       const int* midiMessageTimes, int midiTimeOffset);
+    void renderBlock (const choc::audio::AudioMIDIBlockDispatcher::Block&, bool replaceOutput,
+                      const int* midiMessageTimes, int midiTimeOffset);
+
+    bool postTimedInput (EndpointHandle, uint32_t typeIndexOrFramesToReachValue, uint64_t frame,
+                         bool isValue, const void* data, uint32_t dataSize);
+    void collectTimedInputs();
+    uint32_t getFramesUntilNextTimedValue (uint64_t startFrame, uint32_t numFrames) const;
+    void dispatchTimedInputs (uint64_t startFrame, uint32_t numFrames);
+
+    template <typename SampleType>
+    choc::buffer::InterleavedView<const SampleType> readOutputFrames (EndpointHandle,
+                                                                      const choc::buffer::InterleavedView<SampleType>& scratch,
+                                                                      AudioDataListener*);
+
+    void handleOutputEvents (const choc::audio::AudioMIDIBlockDispatcher::Block&);
+
+    void addRoutingOp (std::vector<RoutingOp>&, RoutingOp::Type, EndpointHandle, uint32_t numEndpointChannels, bool isFloat64,
+                       const std::vector<ChannelMapping>&, std::shared_ptr<AudioDataListener>);
+    void runRoutingOps (const std::vector<RoutingOp>&, const choc::audio::AudioMIDIBlockDispatcher::Block&);
+
+    template <typename SampleType>
+    void runOutputRoutingOp (const RoutingOp&, const ChannelMapping*, const choc::audio::AudioMIDIBlockDispatcher::Block&);
+
+    //==============================================================================
+    // This is written only by the audio thread, and the counters are atomics so that
+    // other threads can read them without any locking.
+    struct AdvanceTimingHistogram
+    {
+        static constexpr uint32_t numDurationBuckets = 128;   // quarter-octaves of nanoseconds
+        static constexpr uint32_t numBlockSizeBuckets = 12;   // powers of two up to 2048+
+
+        void reset();
+        void add (uint64_t nanoseconds, uint32_t numFrames, bool missedDeadline);
+        static uint32_t getBlockSizeBucket (uint32_t numFrames);
+
+        std::atomic<uint64_t> durationCounts[numDurationBuckets] = {};
+        std::atomic<uint64_t> blockSizeCounts[numBlockSizeBuckets] = {},
+                              blockSizeDeadlineMisses[numBlockSizeBuckets] = {},
+                              blockSizeTotalNanoseconds[numBlockSizeBuckets] = {};
+        std::atomic<uint64_t> numBlocks { 0 }, numDeadlineMisses { 0 },
+                              minNanoseconds { 0 }, maxNanoseconds { 0 };
+        std::atomic<bool> resetPending { false };
+    };
+
+    AdvanceTimingHistogram advanceTimings;
+    double frequency = 0;
 };
 
 
@@ -208,6 +383,18 @@ static uint32_t getNumFloatChannelsInStream (const cmaj::EndpointDetails& detail
     return 0;
 }
 
+static bool isDirectChannelMapping (const std::vector<uint32_t>& endpointChannels, uint32_t numChannelsInEndpoint)
+{
+    if (endpointChannels.size() != numChannelsInEndpoint)
+        return false;
+
+    for (uint32_t i = 0; i < numChannelsInEndpoint; ++i)
+        if (endpointChannels[i] != i)
+            return false;
+
+    return true;
+}
+
 static uint32_t countTotalAudioChannels (const cmaj::EndpointDetailsList& endpoints)
 {
     uint32_t total = 0;
@@ -231,7 +418,32 @@ inline void AudioMIDIPerformer::Builder::ensureInputScratchBufferChannelCount (u
     auto& buffer = result->audioInputScratchBuffer.buffer;
 
     buffer.resize ({ std::max (buffer.getNumChannels(), channelsNeeded),
-                     std::max (buffer.getNumFrames(), maxFramesPerBlock) });
+                     std::max (buffer.getNumFrames(), result->maxFramesPerBlock) });
+}
+
+inline void AudioMIDIPerformer::addRoutingOp (std::vector<RoutingOp>& ops, RoutingOp::Type type, EndpointHandle endpoint,
+                                              uint32_t numEndpointChannels, bool isFloat64,
+                                              const std::vector<ChannelMapping>& mappings,
+                                              std::shared_ptr<AudioDataListener> listener)
+{
+    RoutingOp op;
+    op.type = type;
+    op.isFloat64 = isFloat64;
+    op.endpoint = endpoint;
+    op.numEndpointChannels = numEndpointChannels;
+    op.firstMapping = static_cast<uint32_t> (routingChannelMappings.size());
+    op.numMappings = static_cast<uint32_t> (mappings.size());
+    op.listener = listener.get();
+
+    routingChannelMappings.insert (routingChannelMappings.end(), mappings.begin(), mappings.end());
+
+    if (routingChannelPointers.size() < mappings.size())
+        routingChannelPointers.resize (mappings.size());
+
+    if (listener != nullptr)
+        routingListeners.push_back (std::move (listener));
+
+    ops.push_back (op);
 }
 
 inline bool AudioMIDIPerformer::Builder::connectAudioInputTo (const std::vector<uint32_t>& inputChannels,
@@ -243,26 +455,29 @@ inline bool AudioMIDIPerformer::Builder::connectAudioInputTo (const std::vector<
 
     if (auto numChannelsInEndpoint = getNumFloatChannelsInStream (endpoint))
     {
-        ensureInputScratchBufferChannelCount (numChannelsInEndpoint);
         auto endpointHandle = result->engine.getEndpointHandle (endpoint.endpointID);
+        std::vector<ChannelMapping> mappings;
 
-        result->preRenderFunctions.push_back ([amp = result.get(), endpointHandle, numChannelsInEndpoint,
-                                               endpointChannels, inputChannels, listener]
-                                              (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-        {
-            auto numFrames = block.audioInput.getNumFrames();
-            auto interleavedBuffer = amp->audioInputScratchBuffer.getInterleavedBuffer ({ numChannelsInEndpoint, numFrames });
-
-            for (uint32_t i = 0; i < inputChannels.size(); i++)
-                copy (interleavedBuffer.getChannel (endpointChannels[i]),
-                        block.audioInput.getChannel (inputChannels[i]));
+        for (uint32_t i = 0; i < inputChannels.size(); ++i)
+            mappings.push_back ({ inputChannels[i], endpointChannels[i], false });
 
-            if (listener)
-                listener->process (interleavedBuffer);
+        // The scratch buffer is also needed by the direct version if the performer turns
+        // out to only accept interleaved data
+        ensureInputScratchBufferChannelCount (numChannelsInEndpoint);
 
-            amp->performer.setInputFrames (endpointHandle, interleavedBuffer.data.data, numFrames);
-        });
+        // If the host channels map directly onto the endpoint's channels, we can pass them
+        // over as a channel array and avoid interleaving them into the scratch buffer
+        if (listener == nullptr
+             && isFloat32 (endpoint.dataTypes.front())
+             && isDirectChannelMapping (endpointChannels, numChannelsInEndpoint))
+        {
+            result->addRoutingOp (result->inputRoutingOps, RoutingOp::Type::setInputFramesDirect,
+                                  endpointHandle, numChannelsInEndpoint, false, mappings, {});
+            return true;
+        }
 
+        result->addRoutingOp (result->inputRoutingOps, RoutingOp::Type::setInputFramesInterleaved,
+                              endpointHandle, numChannelsInEndpoint, false, mappings, std::move (listener));
         return true;
     }
 
@@ -277,47 +492,14 @@ inline void AudioMIDIPerformer::Builder::createOutputChannelClearAction()
         if (audioOutputChannelsUsed[i])
             highestUsedChannel = i + 1;
 
-    if (highestUsedChannel == 0)
-    {
-        result->postRenderReplaceFunctions.push_back ([] (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-        {
-            block.audioOutput.clear();
-        });
-    }
-    else
-    {
-        std::vector<uint32_t> channelsToClear;
-
-        for (uint32_t i = 0; i < highestUsedChannel; ++i)
-            if (! audioOutputChannelsUsed[i])
-                channelsToClear.push_back (i);
-
-        if (channelsToClear.empty())
-        {
-            result->postRenderReplaceFunctions.push_back ([highestUsedChannel]
-                                                          (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                auto totalChans = block.audioOutput.getNumChannels();
-
-                if (totalChans > highestUsedChannel)
-                    block.audioOutput.getChannelRange ({ highestUsedChannel, totalChans }).clear();
-            });
-        }
-        else
-        {
-            result->postRenderReplaceFunctions.push_back ([channelsToClear, highestUsedChannel]
-                                                          (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                for (auto chan : channelsToClear)
-                    block.audioOutput.getChannel (chan).clear();
-
-                auto totalChans = block.audioOutput.getNumChannels();
+    // The clear operations keep their channel number in the dest field of a mapping
+    for (uint32_t i = 0; i < highestUsedChannel; ++i)
+        if (! audioOutputChannelsUsed[i])
+            result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::clearOutputChannel,
+                                  {}, 0, false, { { 0, i, false } }, {});
 
-                if (totalChans > highestUsedChannel)
-                    block.audioOutput.getChannelRange ({ highestUsedChannel, totalChans }).clear();
-            });
-        }
-    }
+    result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::clearOutputChannelsFrom,
+                          {}, 0, false, { { 0, highestUsedChannel, false } }, {});
 }
 
 template <typename SampleType>
@@ -329,43 +511,23 @@ void AudioMIDIPerformer::Builder::addOutputCopyFunction (EndpointHandle endpoint
 {
     CMAJ_ASSERT (endpointChannels.size() == outputChannels.size());
 
-    auto scratch = choc::buffer::createInterleavedView (reinterpret_cast<SampleType*> (result->audioOutputScratchSpace.data()),
-                                                        numChannelsInEndpoint, maxFramesPerBlock);
+    constexpr bool isFloat64 = std::is_same<SampleType, double>::value;
 
     if (endpointChannels.empty())
     {
         if (listener)
         {
-            result->postRenderAddFunctions.push_back ([amp = result.get(), endpointHandle, scratch, listener]
-                                                      (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                auto destSize = block.audioOutput.getSize();
-                auto source = scratch.getStart (destSize.numFrames);
-
-                amp->performer.copyOutputFrames (endpointHandle, source);
-                listener->process (source);
-            });
-
-            result->postRenderReplaceFunctions.push_back ([amp = result.get(), endpointHandle, scratch, listener]
-                                                          (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                auto destSize = block.audioOutput.getSize();
-                auto source = scratch.getStart (destSize.numFrames);
-
-                amp->performer.copyOutputFrames (endpointHandle, source);
-                listener->process (source);
-            });
+            result->addRoutingOp (result->addOutputRoutingOps, RoutingOp::Type::readOutputForListener,
+                                  endpointHandle, numChannelsInEndpoint, isFloat64, {}, listener);
+            result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::readOutputForListener,
+                                  endpointHandle, numChannelsInEndpoint, isFloat64, {}, listener);
         }
 
         return;
     }
 
-    struct ChannelMap
-    {
-        uint32_t source, dest;
-    };
-
-    std::vector<ChannelMap> channelsToOverwrite, channelsToAddTo, allMappings;
+    std::vector<ChannelMapping> replaceMappings, allMappings;
+    bool anyChannelsToAddTo = false;
 
     for (uint32_t i = 0; i < endpointChannels.size(); ++i)
     {
@@ -377,96 +539,46 @@ void AudioMIDIPerformer::Builder::addOutputCopyFunction (EndpointHandle endpoint
 
         if (audioOutputChannelsUsed[dest])
         {
-            channelsToAddTo.push_back ({ src, dest });
+            replaceMappings.push_back ({ src, dest, true });
+            anyChannelsToAddTo = true;
         }
         else
         {
-            channelsToOverwrite.push_back ({ src, dest });
+            replaceMappings.push_back ({ src, dest, false });
             audioOutputChannelsUsed[dest] = true;
         }
 
-        allMappings.push_back ({ src, dest });
+        allMappings.push_back ({ src, dest, true });
     }
 
-    result->postRenderAddFunctions.push_back ([amp = result.get(), endpointHandle, scratch, allMappings, listener]
-                                              (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-    {
-        auto destSize = block.audioOutput.getSize();
-        auto source = scratch.getStart (destSize.numFrames);
-
-        amp->performer.copyOutputFrames (endpointHandle, source);
+    // Put the channels that get overwritten first, so that any channels that are
+    // added to have been written before the addition happens
+    std::stable_partition (replaceMappings.begin(), replaceMappings.end(),
+                           [] (const ChannelMapping& m) { return ! m.addToDest; });
 
-        if (listener)
-            listener->process (source);
-
-        auto dest = block.audioOutput.getStart (destSize.numFrames);
-
-        for (auto c : allMappings)
-            add (dest.getChannel (c.dest), source.getChannel (c.source));
-    });
+    result->addRoutingOp (result->addOutputRoutingOps, RoutingOp::Type::addOutputViaScratch,
+                          endpointHandle, numChannelsInEndpoint, isFloat64, allMappings, listener);
 
-    if (numChannelsInEndpoint == 1 && channelsToAddTo.empty())
+    if (! isFloat64 && numChannelsInEndpoint == 1 && ! anyChannelsToAddTo)
     {
-        if (channelsToOverwrite.size() == 1)
-        {
-            result->postRenderReplaceFunctions.push_back ([amp = result.get(), endpointHandle, listener, destChannel = channelsToOverwrite.front().dest]
-                                                          (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                auto dest = block.audioOutput.getChannel (destChannel);
-                amp->performer.copyOutputFrames (endpointHandle, dest.data.data, dest.getNumFrames());
-
-                if (listener)
-                    listener->process (choc::buffer::createInterleavedView (reinterpret_cast<SampleType*> (dest.data.data), 1u, dest.getNumFrames()));
-            });
-        }
-        else
-        {
-            result->postRenderReplaceFunctions.push_back ([amp = result.get(), endpointHandle, listener, channelsToOverwrite]
-                                                          (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-            {
-                auto firstIndex = channelsToOverwrite.front().dest;
-                auto numOutChans = block.audioOutput.getNumChannels();
-
-                if (firstIndex < numOutChans)
-                {
-                    auto firstChan = block.audioOutput.getChannel (firstIndex);
-                    amp->performer.copyOutputFrames (endpointHandle, firstChan.data.data, firstChan.getNumFrames());
-
-                    if (listener)
-                        listener->process (choc::buffer::createInterleavedView (reinterpret_cast<SampleType*> (firstChan.data.data), 1u, firstChan.getNumFrames()));
-
-                    for (size_t i = 1; i < channelsToOverwrite.size(); ++i)
-                    {
-                        auto index = channelsToOverwrite[i].dest;
-
-                        if (index < numOutChans)
-                            copy (block.audioOutput.getChannel (index), firstChan);
-                    }
-                }
-            });
-        }
+        // The performer can write straight into the first channel, and the others are copied from it
+        result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::copyOutputMono,
+                              endpointHandle, numChannelsInEndpoint, isFloat64, replaceMappings, std::move (listener));
+    }
+    else if (! isFloat64
+              && listener == nullptr
+              && ! anyChannelsToAddTo
+              && isDirectChannelMapping (endpointChannels, numChannelsInEndpoint))
+    {
+        // Each endpoint channel goes to its own output channel, so the performer can write
+        // straight into the output buffers without going via the interleaved scratch space
+        result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::copyOutputDirect,
+                              endpointHandle, numChannelsInEndpoint, isFloat64, replaceMappings, {});
     }
     else
     {
-        result->postRenderReplaceFunctions.push_back ([amp = result.get(), endpointHandle, scratch, channelsToOverwrite, channelsToAddTo, listener]
-                                                      (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
-        {
-            auto destSize = block.audioOutput.getSize();
-            auto source = scratch.getStart (destSize.numFrames);
-
-            amp->performer.copyOutputFrames (endpointHandle, source);
-
-            if (listener)
-                listener->process (source);
-
-            auto dest = block.audioOutput.getStart (destSize.numFrames);
-
-            for (auto c : channelsToOverwrite)
-                copy (dest.getChannel (c.dest), source.getChannel (c.source));
-
-            for (auto c : channelsToAddTo)
-                add (dest.getChannel (c.dest), source.getChannel (c.source));
-        });
+        result->addRoutingOp (result->replaceOutputRoutingOps, RoutingOp::Type::copyOutputViaScratch,
+                              endpointHandle, numChannelsInEndpoint, isFloat64, replaceMappings, std::move (listener));
     }
 }
 
@@ -530,6 +642,11 @@ inline bool AudioMIDIPerformer::Builder::setEventOutputHandler (OutputEventsRead
     return ! result->eventOutputHandles.empty();
 }
 
+inline void AudioMIDIPerformer::Builder::setTimestampedMIDIInputEnabled (bool shouldBeEnabled)
+{
+    result->timestampedMIDIInput = shouldBeEnabled;
+}
+
 inline std::unique_ptr<AudioMIDIPerformer> AudioMIDIPerformer::Builder::createPerformer()
 {
     createOutputChannelClearAction();
@@ -542,8 +659,18 @@ inline AudioMIDIPerformer::AudioMIDIPerformer (cmaj::Engine e, uint32_t eventFIF
 {
     eventQueue.reset (eventFIFOSize);
     valueQueue.reset (eventFIFOSize);
+    timedInputQueue.reset (eventFIFOSize);
     outputEventQueue.reset (eventFIFOSize);
 
+    // There's room for everything pending plus a whole FIFO's worth of new items, including
+    // the padding needed to align each one
+    maxTimedInputsInFIFO = eventFIFOSize / timedInputHeaderSize + 1;
+    maxTimedInputDataInFIFO = eventFIFOSize + maxTimedInputsInFIFO * timedInputDataAlignment;
+    pendingTimedInputs.reserve (2 * maxTimedInputsInFIFO);
+    pendingTimedInputData.reserve (2 * static_cast<size_t> (maxTimedInputDataInFIFO));
+    pendingTimedInputScratch.reserve (2 * static_cast<size_t> (maxTimedInputDataInFIFO));
+
+    maxFramesPerBlock = engine.getBuildSettings().getMaxBlockSize();
     endpointTypeCoercionHelpers.initialise (engine, maxFramesPerBlock, true, true);
 
     for (auto& endpoint : engine.getInputEndpoints())
@@ -573,6 +700,27 @@ inline void AudioMIDIPerformer::allocateScratch()
         audioOutputScratchSpace.resize (scratchNeeded);
 }
 
+template <typename SampleType>
+choc::buffer::InterleavedView<const SampleType> AudioMIDIPerformer::readOutputFrames (EndpointHandle endpointHandle,
+                                                                                     const choc::buffer::InterleavedView<SampleType>& scratch,
+                                                                                     AudioDataListener* listener)
+{
+    auto numChannels = scratch.getNumChannels();
+    auto numFrames = scratch.getNumFrames();
+
+    // If nobody needs to look at the data, we can skip a copy by reading straight from the performer's buffer
+    if (listener == nullptr)
+        if (auto data = performer.getOutputFramesPointer (endpointHandle))
+            return choc::buffer::createInterleavedView (static_cast<const SampleType*> (data), numChannels, numFrames);
+
+    performer.copyOutputFrames (endpointHandle, scratch);
+
+    if (listener != nullptr)
+        listener->process (scratch);
+
+    return choc::buffer::createInterleavedView (static_cast<const SampleType*> (scratch.data.data), numChannels, numFrames);
+}
+
 inline bool AudioMIDIPerformer::postEvent (cmaj::EndpointHandle handle, const choc::value::ValueView& value)
 {
     if (auto coercedData = endpointTypeCoercionHelpers.coerceValueToMatchingType (handle, value, EndpointType::event))
@@ -638,6 +786,167 @@ inline bool AudioMIDIPerformer::postValue (const cmaj::EndpointID& endpointID, c
     return false;
 }
 
+inline bool AudioMIDIPerformer::postEventAtFrame (cmaj::EndpointHandle handle, const choc::value::ValueView& value, uint64_t frame)
+{
+    if (auto coercedData = endpointTypeCoercionHelpers.coerceValueToMatchingType (handle, value, EndpointType::event))
+        return postTimedInput (handle, static_cast<uint32_t> (coercedData.typeIndex), frame, false,
+                               coercedData.data.data, static_cast<uint32_t> (coercedData.data.size));
+
+    return false;
+}
+
+inline bool AudioMIDIPerformer::postEventAtFrame (const cmaj::EndpointID& endpointID, const choc::value::ValueView& value, uint64_t frame)
+{
+    auto activeHandle = inputEndpointHandles.find (endpointID.toString());
+
+    if (activeHandle != inputEndpointHandles.end())
+        return postEventAtFrame (activeHandle->second, value, frame);
+
+    return false;
+}
+
+inline bool AudioMIDIPerformer::postValueAtFrame (cmaj::EndpointHandle handle, const choc::value::ValueView& value,
+                                                  uint32_t framesToReachValue, uint64_t frame)
+{
+    if (auto coercedData = endpointTypeCoercionHelpers.coerceValue (handle, value))
+        return postTimedInput (handle, framesToReachValue, frame, true,
+                               coercedData.data, static_cast<uint32_t> (coercedData.size));
+
+    return false;
+}
+
+inline bool AudioMIDIPerformer::postValueAtFrame (const cmaj::EndpointID& endpointID, const choc::value::ValueView& value,
+                                                  uint32_t framesToReachValue, uint64_t frame)
+{
+    auto activeHandle = inputEndpointHandles.find (endpointID.toString());
+
+    if (activeHandle != inputEndpointHandles.end())
+        return postValueAtFrame (activeHandle->second, value, framesToReachValue, frame);
+
+    return false;
+}
+
+inline uint64_t AudioMIDIPerformer::getNumFramesProcessed() const
+{
+    return numFramesProcessed.load (std::memory_order_acquire);
+}
+
+inline bool AudioMIDIPerformer::postTimedInput (EndpointHandle handle, uint32_t typeIndexOrFramesToReachValue, uint64_t frame,
+                                                bool isValue, const void* data, uint32_t dataSize)
+{
+    return timedInputQueue.push (timedInputHeaderSize + dataSize, [&] (void* dest)
+    {
+        auto d = static_cast<uint8_t*> (dest);
+        choc::memory::writeNativeEndian (d, handle);
+        d += sizeof (handle);
+        choc::memory::writeNativeEndian (d, typeIndexOrFramesToReachValue);
+        d += sizeof (typeIndexOrFramesToReachValue);
+        choc::memory::writeNativeEndian (d, frame);
+        d += sizeof (frame);
+        *d++ = isValue ? 1 : 0;
+        std::memcpy (d, data, dataSize);
+    });
+}
+
+inline void AudioMIDIPerformer::collectTimedInputs()
+{
+    // If there isn't room for everything that the FIFO could hold, the new items are
+    // left in there until some of the pending ones have been used up
+    if (pendingTimedInputData.size() + maxTimedInputDataInFIFO > pendingTimedInputData.capacity()
+         || pendingTimedInputs.size() + maxTimedInputsInFIFO > pendingTimedInputs.capacity())
+        return;
+
+    timedInputQueue.popAllAvailable ([this] (const void* data, uint32_t size)
+    {
+        CMAJ_ASSERT (size >= timedInputHeaderSize);
+        auto d = static_cast<const char*> (data);
+
+        TimedInput item;
+        item.endpoint = choc::memory::readNativeEndian<cmaj::EndpointHandle> (d);
+        d += sizeof (item.endpoint);
+        item.typeIndexOrFramesToReachValue = choc::memory::readNativeEndian<uint32_t> (d);
+        d += sizeof (item.typeIndexOrFramesToReachValue);
+        item.frame = choc::memory::readNativeEndian<uint64_t> (d);
+        d += sizeof (item.frame);
+        item.isValue = *d++ != 0;
+        item.dataSize = size - timedInputHeaderSize;
+        item.dataOffset = appendTimedInputData (pendingTimedInputData, d, item.dataSize);
+
+        // items with the same frame stay in the order in which they were posted
+        pendingTimedInputs.insert (std::upper_bound (pendingTimedInputs.begin(), pendingTimedInputs.end(), item.frame,
+                                                     [] (uint64_t frame, const TimedInput& i) { return frame < i.frame; }),
+                                   item);
+    });
+}
+
+inline uint32_t AudioMIDIPerformer::getFramesUntilNextTimedValue (uint64_t startFrame, uint32_t numFrames) const
+{
+    for (auto& item : pendingTimedInputs)
+    {
+        if (item.frame >= startFrame + numFrames)
+            break;
+
+        // events can be given a frame offset, but only by a performer that supports it
+        if ((item.isValue || ! performer.supportsExtendedOperations()) && item.frame > startFrame)
+            return static_cast<uint32_t> (item.frame - startFrame);
+    }
+
+    return numFrames;
+}
+
+inline void AudioMIDIPerformer::dispatchTimedInputs (uint64_t startFrame, uint32_t numFrames)
+{
+    size_t numDispatched = 0;
+
+    for (auto& item : pendingTimedInputs)
+    {
+        if (item.frame >= startFrame + numFrames)
+            break;
+
+        const char* data = pendingTimedInputData.data() + item.dataOffset;
+
+        if (item.isValue)
+        {
+            // the block has already been split so that this lands on its first frame
+            performer.setInputValue (item.endpoint, data, item.typeIndexOrFramesToReachValue);
+        }
+        else if (item.frame > startFrame)
+        {
+            performer.addInputEvent (item.endpoint, item.typeIndexOrFramesToReachValue,
+                                     static_cast<uint32_t> (item.frame - startFrame), data);
+        }
+        else
+        {
+            performer.addInputEvent (item.endpoint, item.typeIndexOrFramesToReachValue, data);
+        }
+
+        ++numDispatched;
+    }
+
+    if (numDispatched == 0)
+        return;
+
+    pendingTimedInputs.erase (pendingTimedInputs.begin(), pendingTimedInputs.begin() + static_cast<std::ptrdiff_t> (numDispatched));
+
+    // Pack the data for the remaining items into the other buffer, and swap them over
+    pendingTimedInputScratch.clear();
+
+    for (auto& item : pendingTimedInputs)
+        item.dataOffset = appendTimedInputData (pendingTimedInputScratch, pendingTimedInputData.data() + item.dataOffset, item.dataSize);
+
+    std::swap (pendingTimedInputData, pendingTimedInputScratch);
+}
+
+inline uint32_t AudioMIDIPerformer::appendTimedInputData (std::vector<char>& dest, const char* data, uint32_t size)
+{
+    auto offset = (dest.size() + timedInputDataAlignment - 1) / timedInputDataAlignment * timedInputDataAlignment;
+
+    // the capacity has been reserved for the padding too, so neither of these will allocate
+    dest.resize (offset);
+    dest.insert (dest.end(), data, data + size);
+    return static_cast<uint32_t> (offset);
+}
+
 //==============================================================================
 inline bool AudioMIDIPerformer::prepareToStart()
 {
@@ -648,6 +957,8 @@ inline bool AudioMIDIPerformer::prepareToStart()
 
     currentMaxBlockSize = std::min (maxFramesPerBlock, performer.getMaximumBlockSize());
     midiOutputMessages.reserve (midiOutputEndpoints.size() * performer.getEventBufferSize());
+    frequency = engine.getBuildSettings().getFrequency();
+    advanceTimings.reset();
     endpointTypeCoercionHelpers.initialiseDictionary (performer);
     return true;
 }
@@ -659,6 +970,13 @@ inline void AudioMIDIPerformer::playbackStopped()
 
 //==============================================================================
 inline bool AudioMIDIPerformer::process (const choc::audio::AudioMIDIBlockDispatcher::Block& block, bool replaceOutput)
+{
+    collectTimedInputs();
+    return processBlock (block, replaceOutput, nullptr, 0);
+}
+
+inline bool AudioMIDIPerformer::processBlock (const choc::audio::AudioMIDIBlockDispatcher::Block& block, bool replaceOutput,
+                                              const int* midiMessageTimes, int midiTimeOffset)
 {
     try
     {
@@ -669,14 +987,24 @@ inline bool AudioMIDIPerformer::process (const choc::audio::AudioMIDIBlockDispat
 
         if (numFrames > currentMaxBlockSize)
         {
+            CMAJ_ASSERT (midiMessageTimes == nullptr); // timestamped blocks are pre-split by the caller
+
             for (uint32_t start = 0; start < numFrames;)
             {
                 auto numToDo = std::min (currentMaxBlockSize, numFrames - start);
 
-                if (! process ({ block.audioInput.getFrameRange ({ start, start + numToDo }),
-                                 block.audioOutput.getFrameRange ({ start, start + numToDo }),
-                                 start == 0 ? block.midiMessages : choc::span<choc::midi::ShortMessage>(),
-                                 block.onMidiOutputMessage }, replaceOutput))
+                // the MIDI output times need to be relative to the start of the whole block
+                choc::audio::AudioMIDIBlockDispatcher::HandleMIDIMessageFn sendMidiOut;
+
+                if (start == 0 || block.onMidiOutputMessage == nullptr)
+                    sendMidiOut = block.onMidiOutputMessage;
+                else
+                    sendMidiOut = [&block, start] (uint32_t frame, choc::midi::ShortMessage m) { block.onMidiOutputMessage (start + frame, m); };
+
+                if (! processBlock ({ block.audioInput.getFrameRange ({ start, start + numToDo }),
+                                      block.audioOutput.getFrameRange ({ start, start + numToDo }),
+                                      start == 0 ? block.midiMessages : choc::span<choc::midi::ShortMessage>(),
+                                      sendMidiOut }, replaceOutput, nullptr, 0))
                     return false;
 
                 start += numToDo;
@@ -685,65 +1013,55 @@ inline bool AudioMIDIPerformer::process (const choc::audio::AudioMIDIBlockDispat
             return true;
         }
 
-        performer.setBlockSize (numFrames);
-
-        for (auto& f : preRenderFunctions)
-            f (block);
+        auto blockStartFrame = numFramesProcessed.load (std::memory_order_relaxed);
+        auto numBeforeFirstValue = getFramesUntilNextTimedValue (blockStartFrame, numFrames);
 
-        eventQueue.popAllAvailable ([&] (const void* data, uint32_t size)
+        if (numBeforeFirstValue == numFrames)
         {
-            (void) size;
-            CMAJ_ASSERT (size > 4);
-            auto d = static_cast<const char*> (data);
-            auto handle = choc::memory::readNativeEndian<cmaj::EndpointHandle> (d);
-            d += sizeof (handle);
-            auto typeIndex = choc::memory::readNativeEndian<uint32_t> (d);
-            d += sizeof (typeIndex);
+            renderBlock (block, replaceOutput, midiMessageTimes, midiTimeOffset);
+            return true;
+        }
 
-            performer.addInputEvent (handle, typeIndex, d);
-        });
+        // A timestamped value changes part-way through this block, so it gets split at
+        // those frames. Untimed MIDI goes into the first piece, and timestamped MIDI is
+        // divided up according to the message times.
+        uint32_t midiStartIndex = 0;
+        auto numMIDIMessages = static_cast<uint32_t> (block.midiMessages.size());
 
-        valueQueue.popAllAvailable ([&] (const void* data, uint32_t size)
+        for (uint32_t start = 0; start < numFrames;)
         {
-            (void) size;
-            CMAJ_ASSERT (size > 4);
-            auto d = static_cast<const char*> (data);
-            auto handle = choc::memory::readNativeEndian<cmaj::EndpointHandle> (d);
-            d += sizeof (handle);
-            auto frameCount = choc::memory::readNativeEndian<uint32_t> (d);
-            d += sizeof (frameCount);
+            auto end = start + (start == 0 ? numBeforeFirstValue
+                                           : getFramesUntilNextTimedValue (blockStartFrame + start, numFrames - start));
+            auto endOfMIDI = numMIDIMessages;
 
-            performer.setInputValue (handle, d, frameCount);
-        });
-
-        if (! midiInputEndpoints.empty())
-        {
-            for (auto midiEvent : block.midiMessages)
+            if (midiMessageTimes != nullptr && end < numFrames)
             {
-                auto bytes = midiEvent.data;
-                auto packedMIDI = static_cast<int32_t> ((bytes[0] << 16) | (bytes[1] << 8) | bytes[2]);
+                endOfMIDI = midiStartIndex;
 
-                for (auto& midiEndpoint : midiInputEndpoints)
-                    performer.addInputEvent (midiEndpoint, 0, packedMIDI);
+                while (endOfMIDI < numMIDIMessages && midiMessageTimes[endOfMIDI] - midiTimeOffset < static_cast<int> (end))
+                    ++endOfMIDI;
             }
-        }
 
-        performer.advance();
-        dispatchMIDIOutputEvents (block);
+            choc::audio::AudioMIDIBlockDispatcher::HandleMIDIMessageFn sendMidiOut;
 
-        if (replaceOutput)
-        {
-            for (auto& f : postRenderReplaceFunctions)
-                f (block);
-        }
-        else
-        {
-            for (auto& f : postRenderAddFunctions)
-                f (block);
+            if (start == 0 || block.onMidiOutputMessage == nullptr)
+                sendMidiOut = block.onMidiOutputMessage;
+            else
+                sendMidiOut = [&block, start] (uint32_t frame, choc::midi::ShortMessage m) { block.onMidiOutputMessage (start + frame, m); };
+
+            renderBlock ({ block.audioInput.getFrameRange ({ start, end }),
+                           block.audioOutput.getFrameRange ({ start, end }),
+                           choc::span<const choc::midi::ShortMessage> (block.midiMessages.begin() + midiStartIndex,
+                                                                       block.midiMessages.begin() + endOfMIDI),
+                           sendMidiOut },
+                         replaceOutput,
+                         midiMessageTimes != nullptr ? midiMessageTimes + midiStartIndex : nullptr,
+                         midiTimeOffset + static_cast<int> (start));
+
+            start = end;
+            midiStartIndex = endOfMIDI;
         }
 
-        moveOutputEventsToQueue();
-        numFramesProcessed += numFrames;
         return true;
     }
     catch (const std::exception& e)
@@ -758,6 +1076,223 @@ inline bool AudioMIDIPerformer::process (const choc::audio::AudioMIDIBlockDispat
     return false;
 }
 
+inline void AudioMIDIPerformer::renderBlock (const choc::audio::AudioMIDIBlockDispatcher::Block& block, bool replaceOutput,
+                                             const int* midiMessageTimes, int midiTimeOffset)
+{
+    auto numFrames = block.audioOutput.getNumFrames();
+
+    performer.setBlockSize (numFrames);
+
+    eventQueue.popAllAvailable ([&] (const void* data, uint32_t size)
+    {
+        (void) size;
+        CMAJ_ASSERT (size > 4);
+        auto d = static_cast<const char*> (data);
+        auto handle = choc::memory::readNativeEndian<cmaj::EndpointHandle> (d);
+        d += sizeof (handle);
+        auto typeIndex = choc::memory::readNativeEndian<uint32_t> (d);
+        d += sizeof (typeIndex);
+
+        performer.addInputEvent (handle, typeIndex, d);
+    });
+
+    valueQueue.popAllAvailable ([&] (const void* data, uint32_t size)
+    {
+        (void) size;
+        CMAJ_ASSERT (size > 4);
+        auto d = static_cast<const char*> (data);
+        auto handle = choc::memory::readNativeEndian<cmaj::EndpointHandle> (d);
+        d += sizeof (handle);
+        auto frameCount = choc::memory::readNativeEndian<uint32_t> (d);
+        d += sizeof (frameCount);
+
+        performer.setInputValue (handle, d, frameCount);
+    });
+
+    if (! pendingTimedInputs.empty())
+        dispatchTimedInputs (numFramesProcessed.load (std::memory_order_relaxed), numFrames);
+
+    if (! midiInputEndpoints.empty())
+    {
+        for (size_t i = 0; i < block.midiMessages.size(); ++i)
+        {
+            auto bytes = block.midiMessages[i].data;
+            auto packedMIDI = static_cast<int32_t> ((bytes[0] << 16) | (bytes[1] << 8) | bytes[2]);
+
+            if (midiMessageTimes != nullptr)
+            {
+                auto frame = static_cast<uint32_t> (std::clamp (midiMessageTimes[i] - midiTimeOffset, 0, static_cast<int> (numFrames) - 1));
+
+                for (auto& midiEndpoint : midiInputEndpoints)
+                    performer.addInputEvent (midiEndpoint, 0, frame, packedMIDI);
+            }
+            else
+            {
+                for (auto& midiEndpoint : midiInputEndpoints)
+                    performer.addInputEvent (midiEndpoint, 0, packedMIDI);
+            }
+        }
+    }
+
+    // The audio goes in after the events, because a performer may need to buffer the
+    // input frames if there are timestamped events that will split the block
+    runRoutingOps (inputRoutingOps, block);
+
+    if (advanceTimings.resetPending.exchange (false, std::memory_order_acquire))
+        advanceTimings.reset();
+
+    auto advanceStartTime = std::chrono::steady_clock::now();
+    performer.advance();
+    auto advanceNanoseconds = static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - advanceStartTime).count());
+
+    advanceTimings.add (advanceNanoseconds, numFrames,
+                        frequency > 0 && static_cast<double> (advanceNanoseconds) > numFrames * 1.0e9 / frequency);
+
+    handleOutputEvents (block);
+
+    runRoutingOps (replaceOutput ? replaceOutputRoutingOps : addOutputRoutingOps, block);
+
+    numFramesProcessed.fetch_add (numFrames, std::memory_order_release);
+}
+
+//==============================================================================
+inline void AudioMIDIPerformer::runRoutingOps (const std::vector<RoutingOp>& ops,
+                                               const choc::audio::AudioMIDIBlockDispatcher::Block& block)
+{
+    for (auto& op : ops)
+    {
+        auto mappings = routingChannelMappings.data() + op.firstMapping;
+
+        switch (op.type)
+        {
+            case RoutingOp::Type::setInputFramesDirect:
+            {
+                if (performer.supportsExtendedOperations())
+                {
+                    for (uint32_t i = 0; i < op.numMappings; ++i)
+                        routingChannelPointers[i] = const_cast<float*> (block.audioInput.getChannel (mappings[i].source).data.data);
+
+                    performer.setInputFramesFromChannelArray (op.endpoint, routingChannelPointers.data(),
+                                                              op.numMappings, block.audioInput.getNumFrames());
+                    break;
+                }
+
+                // if the performer can only take interleaved data, this is done in the same way as below
+                [[fallthrough]];
+            }
+
+            case RoutingOp::Type::setInputFramesInterleaved:
+            {
+                auto numFrames = block.audioInput.getNumFrames();
+                auto interleavedBuffer = audioInputScratchBuffer.getInterleavedBuffer ({ op.numEndpointChannels, numFrames });
+
+                for (uint32_t i = 0; i < op.numMappings; ++i)
+                    copy (interleavedBuffer.getChannel (mappings[i].dest),
+                          block.audioInput.getChannel (mappings[i].source));
+
+                if (op.listener != nullptr)
+                    op.listener->process (interleavedBuffer);
+
+                performer.setInputFrames (op.endpoint, interleavedBuffer.data.data, numFrames);
+                break;
+            }
+
+            case RoutingOp::Type::clearOutputChannel:
+            {
+                if (mappings[0].dest < block.audioOutput.getNumChannels())
+                    block.audioOutput.getChannel (mappings[0].dest).clear();
+
+                break;
+            }
+
+            case RoutingOp::Type::clearOutputChannelsFrom:
+            {
+                auto totalChans = block.audioOutput.getNumChannels();
+
+                if (totalChans > mappings[0].dest)
+                    block.audioOutput.getChannelRange ({ mappings[0].dest, totalChans }).clear();
+
+                break;
+            }
+
+            case RoutingOp::Type::copyOutputDirect:
+            {
+                if (! performer.supportsExtendedOperations())
+                {
+                    runOutputRoutingOp<float> (op, mappings, block);
+                    break;
+                }
+
+                for (uint32_t i = 0; i < op.numMappings; ++i)
+                    routingChannelPointers[i] = block.audioOutput.getChannel (mappings[i].dest).data.data;
+
+                performer.copyOutputFramesToChannelArray (op.endpoint, routingChannelPointers.data(),
+                                                          op.numMappings, block.audioOutput.getNumFrames());
+                break;
+            }
+
+            case RoutingOp::Type::copyOutputMono:
+            {
+                auto numOutChans = block.audioOutput.getNumChannels();
+
+                if (mappings[0].dest < numOutChans)
+                {
+                    auto firstChan = block.audioOutput.getChannel (mappings[0].dest);
+                    performer.copyOutputFrames (op.endpoint, firstChan.data.data, firstChan.getNumFrames());
+
+                    if (op.listener != nullptr)
+                        op.listener->process (choc::buffer::createInterleavedView (firstChan.data.data, 1u, firstChan.getNumFrames()));
+
+                    for (uint32_t i = 1; i < op.numMappings; ++i)
+                        if (mappings[i].dest < numOutChans)
+                            copy (block.audioOutput.getChannel (mappings[i].dest), firstChan);
+                }
+
+                break;
+            }
+
+            case RoutingOp::Type::copyOutputViaScratch:
+            case RoutingOp::Type::addOutputViaScratch:
+            case RoutingOp::Type::readOutputForListener:
+            {
+                if (op.isFloat64)
+                    runOutputRoutingOp<double> (op, mappings, block);
+                else
+                    runOutputRoutingOp<float> (op, mappings, block);
+
+                break;
+            }
+        }
+    }
+}
+
+template <typename SampleType>
+void AudioMIDIPerformer::runOutputRoutingOp (const RoutingOp& op, const ChannelMapping* mappings,
+                                             const choc::audio::AudioMIDIBlockDispatcher::Block& block)
+{
+    auto destSize = block.audioOutput.getSize();
+    auto scratch = choc::buffer::createInterleavedView (reinterpret_cast<SampleType*> (audioOutputScratchSpace.data()),
+                                                        op.numEndpointChannels, destSize.numFrames);
+
+    if (op.type == RoutingOp::Type::readOutputForListener)
+    {
+        performer.copyOutputFrames (op.endpoint, scratch);
+        op.listener->process (scratch);
+        return;
+    }
+
+    auto source = readOutputFrames (op.endpoint, scratch, op.listener);
+    auto dest = block.audioOutput.getStart (destSize.numFrames);
+
+    for (uint32_t i = 0; i < op.numMappings; ++i)
+    {
+        if (mappings[i].addToDest)
+            add (dest.getChannel (mappings[i].dest), source.getChannel (mappings[i].source));
+        else
+            copy (dest.getChannel (mappings[i].dest), source.getChannel (mappings[i].source));
+    }
+}
+
 inline bool AudioMIDIPerformer::processWithTimeStampedMIDI (const choc::buffer::ChannelArrayView<const float> audioInput,
                                                             const choc::buffer::ChannelArrayView<float> audioOutput,
                                                             const choc::midi::ShortMessage* midiInMessages,
@@ -769,6 +1304,43 @@ inline bool AudioMIDIPerformer::processWithTimeStampedMIDI (const choc::buffer::
     if (totalNumMIDIMessages == 0)
         return process (choc::audio::AudioMIDIBlockDispatcher::Block { audioInput, audioOutput, {}, sendMidiOut }, replaceOutput);
 
+    collectTimedInputs();
+
+    if (timestampedMIDIInput && performer.supportsExtendedOperations())
+    {
+        if (performer == nullptr)
+            return false;
+
+        auto numFrames = audioOutput.getNumFrames();
+        uint32_t midiStartIndex = 0;
+
+        for (uint32_t start = 0; start < numFrames;)
+        {
+            auto chunkToDo = choc::buffer::FrameRange { start, std::min (numFrames, start + currentMaxBlockSize) };
+            auto endOfMIDI = midiStartIndex;
+
+            while (endOfMIDI < totalNumMIDIMessages && midiInMessageTimes[endOfMIDI] < (int) chunkToDo.end)
+                ++endOfMIDI;
+
+            if (! processBlock (choc::audio::AudioMIDIBlockDispatcher::Block {
+                                    audioInput.getFrameRange (chunkToDo),
+                                    audioOutput.getFrameRange (chunkToDo),
+                                    choc::span<const choc::midi::ShortMessage> (midiInMessages + midiStartIndex,
+                                                                                midiInMessages + endOfMIDI),
+                                    [&] (uint32_t frame, choc::midi::ShortMessage m)
+                                    {
+                                        sendMidiOut (chunkToDo.start + frame, m);
+                                    }
+                                }, replaceOutput, midiInMessageTimes + midiStartIndex, static_cast<int> (chunkToDo.start)))
+                return false;
+
+            start = chunkToDo.end;
+            midiStartIndex = endOfMIDI;
+        }
+
+        return true;
+    }
+
     auto remainingChunk = audioOutput.getFrameRange();
     uint32_t midiStartIndex = 0;
 
@@ -790,16 +1362,16 @@ inline bool AudioMIDIPerformer::processWithTimeStampedMIDI (const choc::buffer::
             ++endOfMIDI;
         }
 
-        if (! process (choc::audio::AudioMIDIBlockDispatcher::Block {
-                           audioInput.getFrameRange (chunkToDo),
-                           audioOutput.getFrameRange (chunkToDo),
-                           choc::span<const choc::midi::ShortMessage> (midiInMessages + midiStartIndex,
-                                                                       midiInMessages + endOfMIDI),
-                           [&] (uint32_t frame, choc::midi::ShortMessage m)
-                           {
-                               sendMidiOut (chunkToDo.start + frame, m);
-                           }
-                       }, replaceOutput))
+        if (! processBlock (choc::audio::AudioMIDIBlockDispatcher::Block {
+                                audioInput.getFrameRange (chunkToDo),
+                                audioOutput.getFrameRange (chunkToDo),
+                                choc::span<const choc::midi::ShortMessage> (midiInMessages + midiStartIndex,
+                                                                            midiInMessages + endOfMIDI),
+                                [&] (uint32_t frame, choc::midi::ShortMessage m)
+                                {
+                                    sendMidiOut (chunkToDo.start + frame, m);
+                                }
+                            }, replaceOutput, nullptr, 0))
             return false;
 
         remainingChunk.start = chunkToDo.end;
@@ -809,36 +1381,130 @@ inline bool AudioMIDIPerformer::processWithTimeStampedMIDI (const choc::buffer::
     return false;
 }
 
-inline void AudioMIDIPerformer::dispatchMIDIOutputEvents (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
+//==============================================================================
+inline void AudioMIDIPerformer::AdvanceTimingHistogram::reset()
 {
-    if (! block.onMidiOutputMessage)
-        return;
+    for (auto& c : durationCounts)               c.store (0, std::memory_order_relaxed);
+    for (auto& c : blockSizeCounts)              c.store (0, std::memory_order_relaxed);
+    for (auto& c : blockSizeDeadlineMisses)      c.store (0, std::memory_order_relaxed);
+    for (auto& c : blockSizeTotalNanoseconds)    c.store (0, std::memory_order_relaxed);
+
+    numDeadlineMisses.store (0, std::memory_order_relaxed);
+    minNanoseconds.store (0, std::memory_order_relaxed);
+    maxNanoseconds.store (0, std::memory_order_relaxed);
+    numBlocks.store (0, std::memory_order_release);
+}
+
+inline uint32_t AudioMIDIPerformer::AdvanceTimingHistogram::getBlockSizeBucket (uint32_t numFrames)
+{
+    uint32_t bucket = 0;
 
-    for (const auto& endpointHandle : midiOutputEndpoints)
+    while (bucket < numBlockSizeBuckets - 1 && (numFrames >> (bucket + 1)) != 0)
+        ++bucket;
+
+    return bucket;
+}
+
+inline void AudioMIDIPerformer::AdvanceTimingHistogram::add (uint64_t nanoseconds, uint32_t numFrames, bool missedDeadline)
+{
+    // There's only one writer, so these don't need to be atomic read-modify-write operations
+    auto increment = [] (std::atomic<uint64_t>& value, uint64_t amount)
     {
-        performer.iterateOutputEvents (endpointHandle,
-                                        [this] (EndpointHandle, uint32_t,
-                                        uint32_t frameOffset, const void* data, uint32_t size) -> bool
-        {
-            (void) size;
-            CMAJ_ASSERT (size >= (3 * sizeof (uint8_t)));
-            auto packed = *static_cast<const int32_t*> (data);
-            midiOutputMessages.push_back ({ MIDIEvents::packedMIDIDataToMessage (packed), frameOffset });
-            return true;
-        });
+        value.store (value.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    };
+
+    auto sizeBucket = getBlockSizeBucket (numFrames);
+
+    increment (durationCounts[DurationHistogramBuckets::getBucket (nanoseconds, numDurationBuckets)], 1);
+    increment (blockSizeCounts[sizeBucket], 1);
+    increment (blockSizeTotalNanoseconds[sizeBucket], nanoseconds);
+
+    if (missedDeadline)
+    {
+        increment (blockSizeDeadlineMisses[sizeBucket], 1);
+        increment (numDeadlineMisses, 1);
     }
 
-    if (midiOutputMessages.empty())
-        return;
+    auto previousNumBlocks = numBlocks.load (std::memory_order_relaxed);
 
-    // Sort the messages in case they come from multiple endpoints
-    choc::sorting::stable_sort (midiOutputMessages.begin(), midiOutputMessages.end(),
-                                [] (const auto& m1, const auto& m2) { return m1.second < m2.second; });
+    if (previousNumBlocks == 0 || nanoseconds < minNanoseconds.load (std::memory_order_relaxed))
+        minNanoseconds.store (nanoseconds, std::memory_order_relaxed);
 
-    for (const auto& m : midiOutputMessages)
-        block.onMidiOutputMessage (m.second, m.first);
+    if (nanoseconds > maxNanoseconds.load (std::memory_order_relaxed))
+        maxNanoseconds.store (nanoseconds, std::memory_order_relaxed);
 
-    midiOutputMessages.clear();
+    numBlocks.store (previousNumBlocks + 1, std::memory_order_release);
+}
+
+inline AudioMIDIPerformer::AdvanceTimingStats AudioMIDIPerformer::getAdvanceTimingStats() const
+{
+    AdvanceTimingStats stats;
+    auto& h = advanceTimings;
+
+    stats.numBlocks = h.numBlocks.load (std::memory_order_acquire);
+    stats.numDeadlineMisses = h.numDeadlineMisses.load (std::memory_order_relaxed);
+    stats.minSeconds = static_cast<double> (h.minNanoseconds.load (std::memory_order_relaxed)) * 1.0e-9;
+    stats.maxSeconds = static_cast<double> (h.maxNanoseconds.load (std::memory_order_relaxed)) * 1.0e-9;
+
+    uint64_t counts[AdvanceTimingHistogram::numDurationBuckets];
+
+    for (uint32_t i = 0; i < AdvanceTimingHistogram::numDurationBuckets; ++i)
+        counts[i] = h.durationCounts[i].load (std::memory_order_relaxed);
+
+    auto getPercentile = [&] (double proportion)
+    {
+        return DurationHistogramBuckets::getPercentileSeconds (counts, AdvanceTimingHistogram::numDurationBuckets,
+                                                               proportion, stats.maxSeconds);
+    };
+
+    stats.p50Seconds  = getPercentile (0.5);
+    stats.p99Seconds  = getPercentile (0.99);
+    stats.p999Seconds = getPercentile (0.999);
+
+    for (uint32_t i = 0; i < AdvanceTimingHistogram::numBlockSizeBuckets; ++i)
+    {
+        if (auto numBlocks = h.blockSizeCounts[i].load (std::memory_order_relaxed))
+        {
+            AdvanceTimingStats::BlockSizeBucket bucket;
+            bucket.minFrames = i == 0 ? 1u : (1u << i);
+            bucket.maxFrames = i == AdvanceTimingHistogram::numBlockSizeBuckets - 1 ? std::numeric_limits<uint32_t>::max()
+                                                                                    : (2u << i) - 1;
+            bucket.numBlocks = numBlocks;
+            bucket.numDeadlineMisses = h.blockSizeDeadlineMisses[i].load (std::memory_order_relaxed);
+            bucket.totalSeconds = static_cast<double> (h.blockSizeTotalNanoseconds[i].load (std::memory_order_relaxed)) * 1.0e-9;
+            stats.blockSizeBuckets.push_back (bucket);
+        }
+    }
+
+    return stats;
+}
+
+inline void AudioMIDIPerformer::resetAdvanceTimingStats()
+{
+    advanceTimings.resetPending.store (true, std::memory_order_release);
+}
+
+inline choc::value::Value AudioMIDIPerformer::AdvanceTimingStats::toValue() const
+{
+    auto buckets = choc::value::createEmptyArray();
+
+    for (auto& b : blockSizeBuckets)
+        buckets.addArrayElement (choc::value::createObject ("BlockSizeBucket",
+                                                            "minFrames", static_cast<int64_t> (b.minFrames),
+                                                            "maxFrames", static_cast<int64_t> (b.maxFrames),
+                                                            "numBlocks", static_cast<int64_t> (b.numBlocks),
+                                                            "numDeadlineMisses", static_cast<int64_t> (b.numDeadlineMisses),
+                                                            "totalSeconds", b.totalSeconds));
+
+    return choc::value::createObject ("AdvanceTimingStats",
+                                      "numBlocks", static_cast<int64_t> (numBlocks),
+                                      "numDeadlineMisses", static_cast<int64_t> (numDeadlineMisses),
+                                      "minSeconds", minSeconds,
+                                      "maxSeconds", maxSeconds,
+                                      "p50Seconds", p50Seconds,
+                                      "p99Seconds", p99Seconds,
+                                      "p999Seconds", p999Seconds,
+                                      "blockSizeBuckets", buckets);
 }
 
 inline void AudioMIDIPerformer::handlePendingOutputEvents (OutputEventHandlerFn&& handler)
@@ -863,41 +1529,93 @@ inline void AudioMIDIPerformer::handlePendingOutputEvents (OutputEventHandlerFn&
     });
 }
 
-inline void AudioMIDIPerformer::moveOutputEventsToQueue()
+inline void AudioMIDIPerformer::handleOutputEvents (const choc::audio::AudioMIDIBlockDispatcher::Block& block)
 {
-    if (outputEventsReadyHandler)
+    bool sendMIDI = block.onMidiOutputMessage && ! midiOutputEndpoints.empty();
+    bool queueEvents = outputEventsReadyHandler && ! eventOutputHandles.empty();
+
+    if (! (sendMIDI || queueEvents))
+        return;
+
+    bool anyEventsQueued = false, collectMIDI = false;
+
+    auto handleEvent = [&] (EndpointHandle h, uint32_t dataTypeIndex, uint32_t frameOffset,
+                            const void* valueData, uint32_t valueDataSize) -> bool
     {
-        bool anyEvents = false;
+        if (sendMIDI && std::find (midiOutputEndpoints.begin(), midiOutputEndpoints.end(), h) != midiOutputEndpoints.end())
+        {
+            CMAJ_ASSERT (valueDataSize >= (3 * sizeof (uint8_t)));
+            auto packed = *static_cast<const int32_t*> (valueData);
 
-        for (const auto& handle : eventOutputHandles)
+            if (collectMIDI)
+                midiOutputMessages.push_back ({ MIDIEvents::packedMIDIDataToMessage (packed), frameOffset });
+            else
+                block.onMidiOutputMessage (frameOffset, MIDIEvents::packedMIDIDataToMessage (packed));
+        }
+
+        if (queueEvents)
         {
-            performer.iterateOutputEvents (handle.first,
-                                           [this, &anyEvents] (EndpointHandle h, uint32_t dataTypeIndex, uint32_t frameOffset,
-                                                               const void* valueData, uint32_t valueDataSize) -> bool
+            for (auto& eventOutput : eventOutputHandles)
             {
-                auto frame = numFramesProcessed + frameOffset;
-                auto totalSize = static_cast<uint32_t> (sizeof (h) + sizeof (dataTypeIndex) + sizeof (frame) + valueDataSize);
-
-                bool ok = outputEventQueue.push (totalSize, [=] (void* dest)
+                if (eventOutput.first == h)
                 {
-                    auto d = static_cast<uint8_t*> (dest);
-                    choc::memory::writeNativeEndian (d, h);
-                    d += sizeof (h);
-                    choc::memory::writeNativeEndian (d, dataTypeIndex);
-                    d += sizeof (dataTypeIndex);
-                    choc::memory::writeNativeEndian (d, frame);
-                    d += sizeof (frame);
-                    std::memcpy (d, valueData, valueDataSize);
-                });
-
-                anyEvents = true;
-                return ok;
-            });
+                    auto frame = numFramesProcessed.load (std::memory_order_relaxed) + frameOffset;
+                    auto totalSize = static_cast<uint32_t> (sizeof (h) + sizeof (dataTypeIndex) + sizeof (frame) + valueDataSize);
+
+                    // if the FIFO fills up, drop the remaining events, but keep going for the MIDI
+                    queueEvents = outputEventQueue.push (totalSize, [=] (void* dest)
+                    {
+                        auto d = static_cast<uint8_t*> (dest);
+                        choc::memory::writeNativeEndian (d, h);
+                        d += sizeof (h);
+                        choc::memory::writeNativeEndian (d, dataTypeIndex);
+                        d += sizeof (dataTypeIndex);
+                        choc::memory::writeNativeEndian (d, frame);
+                        d += sizeof (frame);
+                        std::memcpy (d, valueData, valueDataSize);
+                    });
+
+                    anyEventsQueued = anyEventsQueued || queueEvents;
+                    break;
+                }
+            }
         }
 
-        if (anyEvents)
-            outputEventsReadyHandler();
+        return sendMIDI || queueEvents;
+    };
+
+    // The performer gives us the events from all the endpoints in frame order, so the
+    // MIDI can go straight to the host without needing to be sorted
+    if (! performer.iterateAllOutputEvents (handleEvent))
+    {
+        // ..but if it doesn't support that, we'll visit the endpoints one at a time, and
+        // collect the MIDI so that it can be sorted in case it comes from multiple endpoints
+        collectMIDI = sendMIDI;
+
+        for (auto h : midiOutputEndpoints)
+            performer.iterateOutputEvents (h, handleEvent);
+
+        collectMIDI = false;
+
+        if (! midiOutputMessages.empty())
+        {
+            choc::sorting::stable_sort (midiOutputMessages.begin(), midiOutputMessages.end(),
+                                        [] (const auto& m1, const auto& m2) { return m1.second < m2.second; });
+
+            for (const auto& m : midiOutputMessages)
+                block.onMidiOutputMessage (m.second, m.first);
+
+            midiOutputMessages.clear();
+        }
+
+        if (queueEvents)
+            for (auto& eventOutput : eventOutputHandles)
+                if (std::find (midiOutputEndpoints.begin(), midiOutputEndpoints.end(), eventOutput.first) == midiOutputEndpoints.end())
+                    performer.iterateOutputEvents (eventOutput.first, handleEvent);
     }
+
+    if (anyEventsQueued)
+        outputEventsReadyHandler();
 }
 
 } // namespace cmaj
@@ -0,0 +1,485 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "../../choc/platform/choc_Assert.h"
+#include "../COM/cmaj_CacheDatabaseInterface.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// A CacheDatabaseInterface which wraps another one, and compresses the data that
+/// passes through it.
+///
+/// It uses a simple LZ77-style byte codec, which is quick to decompress, and is
+/// fairly effective on the kind of machine code and data that a linked program contains.
+/// Entries that don't get any smaller are stored uncompressed.
+///
+/// The getStats() method tells you the overall compression ratio and how long the
+/// decompression is taking, so you can decide whether it's worth the trade-off.
+///
+struct CompressingCacheDatabase   : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseInterface, CompressingCacheDatabase>
+{
+    CompressingCacheDatabase (CacheDatabaseInterface::Ptr cacheToWrap)  : target (std::move (cacheToWrap))
+    {
+        CHOC_ASSERT (target != nullptr);
+    }
+
+    virtual ~CompressingCacheDatabase() = default;
+
+    void store (const char* key, const void* dataToSave, uint64_t dataSize) override;
+    uint64_t reload (const char* key, void* destAddress, uint64_t destSize) override;
+    CacheDatabaseMappedRegion* reloadMapped (const char* key) override;
+
+    //==============================================================================
+    struct Stats
+    {
+        uint64_t numEntriesStored = 0, uncompressedBytesStored = 0, compressedBytesStored = 0;
+        uint64_t numEntriesDecompressed = 0;
+        double totalDecompressionSeconds = 0;
+
+        /// Returns the ratio of uncompressed to compressed size for everything stored so far
+        double getCompressionRatio() const;
+        double getAverageDecompressionSeconds() const;
+    };
+
+    Stats getStats() const;
+    void resetStats();
+
+    //==============================================================================
+    /// The codec used to compress the data. Its output begins with a header, so that
+    /// the original size is known when it's decompressed.
+    struct Codec
+    {
+        static std::vector<uint8_t> compress (const void* source, uint64_t size);
+
+        /// Returns the uncompressed size of a block, or 0 if it isn't valid.
+        static uint64_t getUncompressedSize (const void* compressedData, uint64_t compressedSize);
+
+        /// Decompresses a block into a buffer which must be the size that
+        /// getUncompressedSize() returned. Returns false if the data is corrupt.
+        static bool decompress (const void* compressedData, uint64_t compressedSize, void* dest, uint64_t destSize);
+    };
+
+private:
+    CacheDatabaseInterface::Ptr target;
+
+    mutable std::mutex statsLock;
+    Stats stats;
+
+    /// When the caller asks for an entry's size, the whole thing has to be decompressed
+    /// to find out, so the result is kept here until the caller asks for the data.
+    struct PendingReload
+    {
+        std::string key;
+        std::vector<uint8_t> data;
+    };
+
+    static constexpr size_t maxPendingReloads = 8;
+    std::mutex pendingLock;
+    std::vector<PendingReload> pendingReloads;
+
+    struct DecompressedRegion;
+
+    bool loadAndDecompress (const char* key, std::vector<uint8_t>& result);
+    bool decompress (const void* compressedData, uint64_t compressedSize, std::vector<uint8_t>& result);
+};
+
+
+
+//==============================================================================
+//        _        _           _  _
+//     __| |  ___ | |_   __ _ (_)| | ___
+//    / _` | / _ \| __| / _` || || |/ __|
+//   | (_| ||  __/| |_ | (_| || || |\__ \ _  _  _
+//    \__,_| \___| \__| \__,_||_||_||___/(_)(_)(_)
+//
+//   Code beyond this point is implementation detail...
+//
+//==============================================================================
+
+namespace lz_codec
+{
+    static constexpr uint32_t magicNumber = 0x5a4c4d43; // "CMLZ"
+    static constexpr uint32_t formatRaw = 0, formatCompressed = 1;
+    static constexpr uint32_t minMatchLength = 4, lastLiteralsLength = 5, maxOffset = 65535;
+    static constexpr uint32_t hashBits = 14;
+
+    struct Header
+    {
+        uint32_t magic, format;
+        uint64_t uncompressedSize;
+    };
+
+    inline uint32_t read32 (const uint8_t* p)
+    {
+        uint32_t v;
+        std::memcpy (std::addressof (v), p, sizeof (v));
+        return v;
+    }
+
+    inline uint32_t hash (uint32_t v)     { return (v * 2654435761u) >> (32 - hashBits); }
+
+    inline void writeLength (std::vector<uint8_t>& out, uint64_t length)
+    {
+        for (; length >= 255; length -= 255)
+            out.push_back (255);
+
+        out.push_back (static_cast<uint8_t> (length));
+    }
+
+    inline void writeSequence (std::vector<uint8_t>& out, const uint8_t* literals, uint64_t numLiterals,
+                               uint32_t offset, uint64_t matchLength)
+    {
+        auto literalCode = static_cast<uint8_t> (std::min<uint64_t> (numLiterals, 15));
+        auto matchCode   = static_cast<uint8_t> (matchLength == 0 ? 0 : std::min<uint64_t> (matchLength - minMatchLength, 15));
+
+        out.push_back (static_cast<uint8_t> ((literalCode << 4) | matchCode));
+
+        if (literalCode == 15)
+            writeLength (out, numLiterals - 15);
+
+        out.insert (out.end(), literals, literals + numLiterals);
+
+        if (matchLength != 0)
+        {
+            out.push_back (static_cast<uint8_t> (offset));
+            out.push_back (static_cast<uint8_t> (offset >> 8));
+
+            if (matchCode == 15)
+                writeLength (out, matchLength - minMatchLength - 15);
+        }
+    }
+
+    inline bool readLength (const uint8_t* source, uint64_t sourceSize, uint64_t& pos, uint64_t& length)
+    {
+        for (;;)
+        {
+            if (pos >= sourceSize)
+                return false;
+
+            auto b = source[pos++];
+            length += b;
+
+            if (b != 255)
+                return true;
+        }
+    }
+}
+
+inline std::vector<uint8_t> CompressingCacheDatabase::Codec::compress (const void* sourceData, uint64_t size)
+{
+    using namespace lz_codec;
+
+    auto source = static_cast<const uint8_t*> (sourceData);
+
+    std::vector<uint8_t> out;
+    out.reserve (static_cast<size_t> (sizeof (Header) + size + size / 255 + 16));
+
+    Header header { magicNumber, formatCompressed, size };
+    out.resize (sizeof (Header));
+    std::memcpy (out.data(), std::addressof (header), sizeof (Header));
+
+    uint64_t anchor = 0, pos = 0;
+
+    if (size > minMatchLength + lastLiteralsLength)
+    {
+        // positions are stored plus one, so that zero means empty
+        std::vector<uint32_t> hashTable (1u << hashBits, 0);
+        auto matchLimit = size - lastLiteralsLength;
+
+        while (pos + minMatchLength <= matchLimit)
+        {
+            auto sequence = read32 (source + pos);
+            auto& slot = hashTable[hash (sequence)];
+            auto candidate = static_cast<uint64_t> (slot);
+            slot = static_cast<uint32_t> (pos + 1);
+
+            if (candidate != 0 && pos + 1 - candidate <= maxOffset && read32 (source + candidate - 1) == sequence)
+            {
+                auto matchStart = candidate - 1;
+                uint64_t matchLength = minMatchLength;
+
+                while (pos + matchLength < matchLimit && source[matchStart + matchLength] == source[pos + matchLength])
+                    ++matchLength;
+
+                writeSequence (out, source + anchor, pos - anchor, static_cast<uint32_t> (pos - matchStart), matchLength);
+                pos += matchLength;
+                anchor = pos;
+            }
+            else
+            {
+                ++pos;
+            }
+        }
+    }
+
+    writeSequence (out, source + anchor, size - anchor, 0, 0);
+
+    // If it didn't help, just store the original data
+    if (out.size() >= sizeof (Header) + size)
+    {
+        header.format = formatRaw;
+        out.resize (static_cast<size_t> (sizeof (Header) + size));
+        std::memcpy (out.data(), std::addressof (header), sizeof (Header));
+
+        if (size != 0)
+            std::memcpy (out.data() + sizeof (Header), source, static_cast<size_t> (size));
+    }
+
+    return out;
+}
+
+inline uint64_t CompressingCacheDatabase::Codec::getUncompressedSize (const void* compressedData, uint64_t compressedSize)
+{
+    using namespace lz_codec;
+
+    if (compressedData == nullptr || compressedSize < sizeof (Header))
+        return 0;
+
+    Header header;
+    std::memcpy (std::addressof (header), compressedData, sizeof (Header));
+
+    if (header.magic != magicNumber || (header.format != formatRaw && header.format != formatCompressed))
+        return 0;
+
+    return header.uncompressedSize;
+}
+
+inline bool CompressingCacheDatabase::Codec::decompress (const void* compressedData, uint64_t compressedSize,
+                                                         void* destData, uint64_t destSize)
+{
+    using namespace lz_codec;
+
+    if (destSize == 0 || getUncompressedSize (compressedData, compressedSize) != destSize)
+        return false;
+
+    Header header;
+    std::memcpy (std::addressof (header), compressedData, sizeof (Header));
+
+    auto source = static_cast<const uint8_t*> (compressedData) + sizeof (Header);
+    auto sourceSize = compressedSize - sizeof (Header);
+    auto dest = static_cast<uint8_t*> (destData);
+
+    if (header.format == formatRaw)
+    {
+        if (sourceSize != destSize)
+            return false;
+
+        std::memcpy (dest, source, static_cast<size_t> (destSize));
+        return true;
+    }
+
+    uint64_t inPos = 0, outPos = 0;
+
+    while (inPos < sourceSize)
+    {
+        auto token = source[inPos++];
+        uint64_t numLiterals = token >> 4;
+
+        if (numLiterals == 15 && ! readLength (source, sourceSize, inPos, numLiterals))
+            return false;
+
+        if (numLiterals > sourceSize - inPos || numLiterals > destSize - outPos)
+            return false;
+
+        std::memcpy (dest + outPos, source + inPos, static_cast<size_t> (numLiterals));
+        inPos += numLiterals;
+        outPos += numLiterals;
+
+        // the final sequence has no match
+        if (inPos == sourceSize)
+            break;
+
+        if (sourceSize - inPos < 2)
+            return false;
+
+        uint64_t offset = source[inPos] | (static_cast<uint64_t> (source[inPos + 1]) << 8);
+        inPos += 2;
+
+        if (offset == 0 || offset > outPos)
+            return false;
+
+        uint64_t matchLength = token & 15u;
+
+        if (matchLength == 15 && ! readLength (source, sourceSize, inPos, matchLength))
+            return false;
+
+        matchLength += minMatchLength;
+
+        if (matchLength > destSize - outPos)
+            return false;
+
+        // the match may overlap the bytes it's producing, so this must go forwards a byte at a time
+        for (uint64_t i = 0; i < matchLength; ++i, ++outPos)
+            dest[outPos] = dest[outPos - offset];
+    }
+
+    return outPos == destSize;
+}
+
+//==============================================================================
+struct CompressingCacheDatabase::DecompressedRegion  : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseMappedRegion, DecompressedRegion>
+{
+    DecompressedRegion (std::vector<uint8_t>&& d) : data (std::move (d)) {}
+    virtual ~DecompressedRegion() = default;
+
+    const void* getData() override     { return data.data(); }
+    uint64_t getSize() override        { return data.size(); }
+
+    std::vector<uint8_t> data;
+};
+
+inline void CompressingCacheDatabase::store (const char* key, const void* dataToSave, uint64_t dataSize)
+{
+    auto compressed = Codec::compress (dataToSave, dataSize);
+    target->store (key, compressed.data(), compressed.size());
+
+    {
+        std::lock_guard<decltype(pendingLock)> l (pendingLock);
+
+        pendingReloads.erase (std::remove_if (pendingReloads.begin(), pendingReloads.end(),
+                                              [&] (const PendingReload& p) { return p.key == key; }),
+                              pendingReloads.end());
+    }
+
+    std::lock_guard<decltype(statsLock)> l (statsLock);
+    stats.numEntriesStored++;
+    stats.uncompressedBytesStored += dataSize;
+    stats.compressedBytesStored += compressed.size();
+}
+
+inline uint64_t CompressingCacheDatabase::reload (const char* key, void* destAddress, uint64_t destSize)
+{
+    std::vector<uint8_t> data;
+
+    {
+        std::lock_guard<decltype(pendingLock)> l (pendingLock);
+
+        for (auto i = pendingReloads.begin(); i != pendingReloads.end(); ++i)
+        {
+            if (i->key == key)
+            {
+                data = std::move (i->data);
+                pendingReloads.erase (i);
+                break;
+            }
+        }
+    }
+
+    if (data.empty() && ! loadAndDecompress (key, data))
+        return 0;
+
+    auto size = static_cast<uint64_t> (data.size());
+
+    if (destAddress == nullptr || destSize < size)
+    {
+        std::lock_guard<decltype(pendingLock)> l (pendingLock);
+
+        if (pendingReloads.size() >= maxPendingReloads)
+            pendingReloads.erase (pendingReloads.begin());
+
+        pendingReloads.push_back ({ key, std::move (data) });
+        return size;
+    }
+
+    std::memcpy (destAddress, data.data(), data.size());
+    return size;
+}
+
+inline CacheDatabaseMappedRegion* CompressingCacheDatabase::reloadMapped (const char* key)
+{
+    std::vector<uint8_t> data;
+
+    if (! loadAndDecompress (key, data))
+        return nullptr;
+
+    return choc::com::create<DecompressedRegion> (std::move (data)).getWithIncrementedRefCount();
+}
+
+inline bool CompressingCacheDatabase::loadAndDecompress (const char* key, std::vector<uint8_t>& result)
+{
+    if (auto mapped = CacheDatabaseMappedRegion::Ptr (target->reloadMapped (key)))
+        return decompress (mapped->getData(), mapped->getSize(), result);
+
+    if (auto size = target->reload (key, nullptr, 0))
+    {
+        std::vector<uint8_t> compressed (static_cast<size_t> (size));
+
+        if (target->reload (key, compressed.data(), size) == size)
+            return decompress (compressed.data(), size, result);
+    }
+
+    return false;
+}
+
+inline bool CompressingCacheDatabase::decompress (const void* compressedData, uint64_t compressedSize, std::vector<uint8_t>& result)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    auto size = Codec::getUncompressedSize (compressedData, compressedSize);
+
+    if (size == 0)
+        return false;
+
+    result.resize (static_cast<size_t> (size));
+
+    if (! Codec::decompress (compressedData, compressedSize, result.data(), size))
+    {
+        result.clear();
+        return false;
+    }
+
+    std::lock_guard<decltype(statsLock)> l (statsLock);
+    stats.numEntriesDecompressed++;
+    stats.totalDecompressionSeconds += std::chrono::duration<double> (std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
+
+inline CompressingCacheDatabase::Stats CompressingCacheDatabase::getStats() const
+{
+    std::lock_guard<decltype(statsLock)> l (statsLock);
+    return stats;
+}
+
+inline void CompressingCacheDatabase::resetStats()
+{
+    std::lock_guard<decltype(statsLock)> l (statsLock);
+    stats = {};
+}
+
+inline double CompressingCacheDatabase::Stats::getCompressionRatio() const
+{
+    return compressedBytesStored == 0 ? 1.0 : static_cast<double> (uncompressedBytesStored) / static_cast<double> (compressedBytesStored);
+}
+
+inline double CompressingCacheDatabase::Stats::getAverageDecompressionSeconds() const
+{
+    return numEntriesDecompressed == 0 ? 0.0 : totalDecompressionSeconds / static_cast<double> (numEntriesDecompressed);
+}
+
+} // namespace cmaj
@@ -0,0 +1,103 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace cmaj
+{
+
+//==============================================================================
+/// Helper functions for histograms of durations, which sort the durations into
+/// buckets that are a quarter of an octave wide (i.e. four buckets for each doubling
+/// of the time), so that a small fixed-size array can cover a huge range of values.
+///
+struct DurationHistogramBuckets
+{
+    /// Returns the bucket for a duration in nanoseconds. Anything too long for
+    /// the last bucket is put into it.
+    static uint32_t getBucket (uint64_t nanoseconds, uint32_t numBuckets);
+
+    /// Estimates a percentile (e.g. 0.99) from a set of bucket counts. The value returned
+    /// is the upper edge of the bucket it falls in, clamped to the longest duration seen.
+    static double getPercentileSeconds (const uint64_t* counts, uint32_t numBuckets,
+                                        double proportion, double maxSeconds);
+};
+
+
+
+//==============================================================================
+//        _        _           _  _
+//     __| |  ___ | |_   __ _ (_)| | ___
+//    / _` | / _ \| __| / _` || || |/ __|
+//   | (_| ||  __/| |_ | (_| || || |\__ \ _  _  _
+//    \__,_| \___| \__| \__,_||_||_||___/(_)(_)(_)
+//
+//   Code beyond this point is implementation detail...
+//
+//==============================================================================
+
+inline uint32_t DurationHistogramBuckets::getBucket (uint64_t nanoseconds, uint32_t numBuckets)
+{
+    if (nanoseconds < 2)
+        return 0;
+
+    // the octave is the position of the top bit, and the next two bits choose the quarter
+    uint32_t octave = 0;
+
+    while ((nanoseconds >> (octave + 1)) != 0)
+        ++octave;
+
+    auto quarter = octave >= 2 ? static_cast<uint32_t> ((nanoseconds >> (octave - 2)) & 3)
+                               : static_cast<uint32_t> ((nanoseconds << (2 - octave)) & 3);
+
+    return std::min (numBuckets - 1, octave * 4 + quarter);
+}
+
+inline double DurationHistogramBuckets::getPercentileSeconds (const uint64_t* counts, uint32_t numBuckets,
+                                                              double proportion, double maxSeconds)
+{
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < numBuckets; ++i)
+        total += counts[i];
+
+    if (total == 0)
+        return 0;
+
+    auto target = static_cast<uint64_t> (std::ceil (proportion * static_cast<double> (total)));
+    uint64_t count = 0;
+
+    for (uint32_t i = 0; i < numBuckets; ++i)
+    {
+        count += counts[i];
+
+        if (count >= target)
+            return std::min (maxSeconds, std::ldexp ((5 + (i & 3)) / 4.0, static_cast<int> (i >> 2)) * 1.0e-9);
+    }
+
+    return maxSeconds;
+}
+
+} // namespace cmaj
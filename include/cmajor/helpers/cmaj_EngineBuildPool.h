@@ -0,0 +1,195 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <future>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include "../API/cmaj_Engine.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// A pool of threads that can load and link several Engines at the same time.
+///
+/// Each task keeps its own copy of the Engine object (which refers to the same
+/// underlying engine), and while a task is queued or running, you mustn't call
+/// any other methods on that engine.
+///
+/// When the pool is destroyed, any tasks that haven't started yet are cancelled,
+/// and it waits for the ones that are already running to finish.
+///
+struct EngineBuildPool
+{
+    /// If numThreads is 0, it'll use one thread per CPU core.
+    EngineBuildPool (uint32_t numThreads = 0);
+    ~EngineBuildPool();
+
+    EngineBuildPool (const EngineBuildPool&) = delete;
+    EngineBuildPool& operator= (const EngineBuildPool&) = delete;
+
+    /// Holds the outcome of a loadAsync(), linkAsync() or addTask() operation.
+    struct BuildResult
+    {
+        bool succeeded = false;
+        DiagnosticMessageList messages;
+    };
+
+    /// Starts loading a program into an engine, and returns a future that will provide the result.
+    std::future<BuildResult> loadAsync (Engine, const Program& programToLoad);
+
+    /// Starts linking the program that an engine has loaded, and returns a future that will
+    /// provide the result. If a cache is supplied, it must remain valid until the link has finished.
+    std::future<BuildResult> linkAsync (Engine, CacheDatabaseInterface* optionalCache = nullptr);
+
+    /// Queues a custom job, e.g. one that creates, loads and links an engine in a single
+    /// task, and returns a future that will provide the result that the job returns.
+    std::future<BuildResult> addTask (std::function<BuildResult()>);
+
+private:
+    //==============================================================================
+    struct Task
+    {
+        std::function<BuildResult()> run;
+        std::promise<BuildResult> result;
+    };
+
+    std::vector<std::thread> threads;
+    std::deque<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool shouldExit = false;
+
+    void runTasks();
+};
+
+
+
+//==============================================================================
+//        _        _           _  _
+//     __| |  ___ | |_   __ _ (_)| | ___
+//    / _` | / _ \| __| / _` || || |/ __|
+//   | (_| ||  __/| |_ | (_| || || |\__ \ _  _  _
+//    \__,_| \___| \__| \__,_||_||_||___/(_)(_)(_)
+//
+//   Code beyond this point is implementation detail...
+//
+//==============================================================================
+
+inline EngineBuildPool::EngineBuildPool (uint32_t numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::max (1u, std::thread::hardware_concurrency());
+
+    for (uint32_t i = 0; i < numThreads; ++i)
+        threads.emplace_back ([this] { runTasks(); });
+}
+
+inline EngineBuildPool::~EngineBuildPool()
+{
+    std::deque<Task> cancelledTasks;
+
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        shouldExit = true;
+        cancelledTasks.swap (tasks);
+    }
+
+    condition.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+
+    // Rather than leaving the futures with a broken promise, the cancelled tasks report an error
+    for (auto& task : cancelledTasks)
+    {
+        BuildResult result;
+        result.messages.add (DiagnosticMessage::createError ("The build was cancelled", {}));
+        task.result.set_value (std::move (result));
+    }
+}
+
+inline std::future<EngineBuildPool::BuildResult> EngineBuildPool::addTask (std::function<BuildResult()> run)
+{
+    Task task { std::move (run), {} };
+    auto future = task.result.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        tasks.push_back (std::move (task));
+    }
+
+    condition.notify_one();
+    return future;
+}
+
+inline void EngineBuildPool::runTasks()
+{
+    for (;;)
+    {
+        Task task;
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            condition.wait (lock, [this] { return shouldExit || ! tasks.empty(); });
+
+            if (tasks.empty())
+                return;
+
+            task = std::move (tasks.front());
+            tasks.pop_front();
+        }
+
+        try
+        {
+            task.result.set_value (task.run());
+        }
+        catch (...)
+        {
+            task.result.set_exception (std::current_exception());
+        }
+    }
+}
+
+inline std::future<EngineBuildPool::BuildResult> EngineBuildPool::loadAsync (Engine engine, const Program& programToLoad)
+{
+    return addTask ([e = std::move (engine), programToLoad]() mutable
+    {
+        BuildResult result;
+        result.succeeded = e.load (result.messages, programToLoad);
+        return result;
+    });
+}
+
+inline std::future<EngineBuildPool::BuildResult> EngineBuildPool::linkAsync (Engine engine, CacheDatabaseInterface* optionalCache)
+{
+    return addTask ([e = std::move (engine), optionalCache]() mutable
+    {
+        BuildResult result;
+        result.succeeded = e.link (result.messages, optionalCache);
+        return result;
+    });
+}
+
+} // namespace cmaj
@@ -21,123 +21,514 @@
 
 #pragma once
 
-#include "../../choc/threading/choc_ThreadSafeFunctor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+#include "../../choc/platform/choc_Platform.h"
+#include "../../choc/text/choc_Files.h"
+#include "../../choc/text/choc_StringUtilities.h"
+#include "../../choc/threading/choc_TaskThread.h"
 #include "../COM/cmaj_CacheDatabaseInterface.h"
+#include "cmaj_DurationHistogram.h"
+
+#if ! CHOC_WINDOWS
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
 
 namespace cmaj
 {
 
 //==============================================================================
 /// A simple implementation of CacheDatabaseInterface that saves the data as
-/// files in a given folder, and deletes the oldest files when a maximum
-/// number exist
+/// files in a given folder, and deletes the least-recently-used files when a
+/// maximum number of files or total size is exceeded.
+/// Reloading an entry doesn't write anything to the filesystem. Instead, the order in
+/// which entries were used is kept in memory, and saved to a small journal file from
+/// time to time, so that it can be restored when the cache is next opened.
+/// Any number of threads can reload entries in parallel. New entries are written to a
+/// temporary file which is then renamed into place, so readers never see a partly-written
+/// file, and only have to wait while the rename happens.
+/// On POSIX systems, reloadMapped() is supported, and maps the cache file
+/// directly into memory rather than copying it.
 struct FileBasedCacheDatabase   : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseInterface, FileBasedCacheDatabase>
 {
-    FileBasedCacheDatabase (std::filesystem::path parentFolder, size_t maxNumFilesAllowed)
-       : folder (std::move (parentFolder)), maxNumFiles (maxNumFilesAllowed)
+    /// If maxTotalBytesAllowed is 0, there's no limit on the total size of the files.
+    FileBasedCacheDatabase (std::filesystem::path parentFolder, size_t maxNumFilesAllowed, uint64_t maxTotalBytesAllowed = 0)
+       : folder (std::move (parentFolder)), maxNumFiles (maxNumFilesAllowed), maxTotalBytes (maxTotalBytesAllowed)
     {
-        purgeThread.start (0, [this] { removeOldFiles(); });
+        removeStaleTempFiles();
+
+        std::vector<std::string> filesToRemove;
+
+        {
+            std::lock_guard<decltype(indexLock)> l (indexLock);
+            scanExistingFiles();
+            applyJournal();
+            filesToRemove = takeFilesToEvict();
+        }
+
+        removeFiles (filesToRemove);
+
+        journalThread.start (journalSaveIntervalMilliseconds, [this] { saveJournalIfNeeded(); });
     }
 
-    virtual ~FileBasedCacheDatabase() = default;
+    virtual ~FileBasedCacheDatabase()
+    {
+        journalThread.stop();
+        saveJournalIfNeeded();
+    }
 
     void store (const char* key, const void* dataToSave, uint64_t dataSize) override
     {
+        auto startTime = std::chrono::steady_clock::now();
+        auto tempFile = folder / (getTempFileNamePrefix() + tempFileNameID + "_" + std::to_string (nextTempFileIndex++) + "_" + key);
+
         try
         {
-            std::lock_guard<decltype(lock)> l (lock);
-            choc::file::replaceFileWithContent (getCacheFile (key).string(),
+            // The slow part happens without any locks held
+            choc::file::replaceFileWithContent (tempFile.string(),
                                                 std::string_view (static_cast<const char*> (dataToSave),
                                                                   static_cast<std::string_view::size_type> (dataSize)));
+
+            std::unique_lock<decltype(fileLock)> l (fileLock);
+            std::filesystem::rename (tempFile, getCacheFile (key));
+
+            std::vector<std::string> filesToRemove;
+
+            {
+                std::lock_guard<decltype(indexLock)> il (indexLock);
+                markAsUsed (key, dataSize);
+                filesToRemove = takeFilesToEvict();
+            }
+
+            removeFiles (filesToRemove);
+            recordStore (dataSize, filesToRemove.size(), startTime);
+        }
+        catch (...)
+        {
+            std::error_code errorCode;
+            std::filesystem::remove (tempFile, errorCode);
         }
-        catch (...) {}
 
-        purgeThread.trigger();
+        journalThread.trigger();
     }
 
     uint64_t reload (const char* key, void* destAddress, uint64_t destSize) override
     {
-        std::lock_guard<decltype(lock)> l (lock);
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t size = 0;
 
         try
         {
+            std::shared_lock<decltype(fileLock)> l (fileLock);
+
             auto file = getCacheFile (key);
-            auto size = file_size (file);
+            size = file_size (file);
 
             if (size == 0)
+            {
+                recordMiss();
                 return 0;
+            }
 
             if (destAddress == nullptr || destSize < size)
                 return size;
 
-            std::fstream stream (file);
+            std::ifstream stream (file, std::ios::binary);
             stream.read (static_cast<char*> (destAddress), static_cast<std::streamsize> (size));
 
             if (stream.gcount() != static_cast<std::streamsize> (size))
+            {
+                recordMiss();
                 return 0;
+            }
+
+            // This happens while the file lock is still held, so that the entry can't
+            // have been evicted since the file was read
+            std::lock_guard<decltype(indexLock)> il (indexLock);
+            markAsUsed (key, size);
+        }
+        catch (...)
+        {
+            recordMiss();
+            return 0;
+        }
+
+        recordHit (size, startTime);
+        return size;
+    }
 
-            // write a byte at the end and then erase it to update the file's modification time
-            stream.put (0);
-            stream.sync();
-            resize_file (file, size);
+    CacheDatabaseMappedRegion* reloadMapped (const char* key) override
+    {
+       #if CHOC_WINDOWS
+        (void) key;
+        return nullptr;
+       #else
+        // If this fails, the caller falls back to reload(), which will count the miss
+        auto startTime = std::chrono::steady_clock::now();
+
+        try
+        {
+            struct stat info;
+            void* data = nullptr;
+
+            {
+                std::shared_lock<decltype(fileLock)> l (fileLock);
+                auto fd = ::open (getCacheFile (key).c_str(), O_RDONLY);
+
+                if (fd < 0)
+                    return nullptr;
+
+                if (::fstat (fd, &info) == 0 && info.st_size > 0)
+                {
+                    data = ::mmap (nullptr, static_cast<size_t> (info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
 
-            return size;
+                    if (data == MAP_FAILED)
+                        data = nullptr;
+                }
+
+                // the mapping keeps the file's pages alive, so the descriptor isn't needed
+                ::close (fd);
+
+                if (data == nullptr)
+                    return nullptr;
+
+                // as in reload(), the file lock is still held so that an evicted entry isn't re-added
+                std::lock_guard<decltype(indexLock)> il (indexLock);
+                markAsUsed (key, static_cast<uint64_t> (info.st_size));
+            }
+
+            recordHit (static_cast<uint64_t> (info.st_size), startTime);
+
+            return choc::com::create<MappedFile> (data, static_cast<uint64_t> (info.st_size)).getWithIncrementedRefCount();
         }
         catch (...) {}
 
-        return 0;
+        return nullptr;
+       #endif
+    }
+
+    //==============================================================================
+    /// A snapshot of the statistics that the cache gathers about its activity.
+    struct Stats
+    {
+        /// Hits and misses only count the reload calls that fetch data, not the
+        /// ones that just ask for an entry's size
+        uint64_t hits = 0, misses = 0, stores = 0, evictions = 0;
+        uint64_t bytesRead = 0, bytesWritten = 0;
+        /// The current contents of the cache
+        uint64_t numFiles = 0, totalBytes = 0;
+        /// Percentiles are estimated from a histogram which has four buckets per octave
+        double storeP50Seconds = 0, storeP99Seconds = 0;
+        double reloadP50Seconds = 0, reloadP99Seconds = 0;
+
+        double getHitRate() const      { return hits + misses == 0 ? 0.0 : static_cast<double> (hits) / static_cast<double> (hits + misses); }
+    };
+
+    /// Returns the statistics gathered since the cache was created, or since resetStats() was called.
+    Stats getStats() const
+    {
+        Stats result;
+
+        {
+            std::lock_guard<decltype(statsLock)> l (statsLock);
+            result = stats;
+            result.storeP50Seconds  = storeTimes.getPercentile (0.5);
+            result.storeP99Seconds  = storeTimes.getPercentile (0.99);
+            result.reloadP50Seconds = reloadTimes.getPercentile (0.5);
+            result.reloadP99Seconds = reloadTimes.getPercentile (0.99);
+        }
+
+        std::lock_guard<decltype(indexLock)> l (indexLock);
+        result.numFiles = files.size();
+        result.totalBytes = totalBytes;
+        return result;
+    }
+
+    void resetStats()
+    {
+        std::lock_guard<decltype(statsLock)> l (statsLock);
+        stats = {};
+        storeTimes = {};
+        reloadTimes = {};
     }
 
 private:
     std::filesystem::path folder;
     size_t maxNumFiles = 0;
-    std::mutex lock;
-    choc::threading::TaskThread purgeThread;
+    uint64_t maxTotalBytes = 0;
+
+    /// Held exclusively while files are being renamed or deleted, and shared by readers
+    std::shared_mutex fileLock;
+    /// Protects the in-memory list of files, and is only ever held briefly
+    mutable std::mutex indexLock;
+    std::atomic<uint64_t> nextTempFileIndex { 0 };
+    /// Makes this instance's temp file names different from those of any other instances
+    /// or processes which are using the same folder
+    const std::string tempFileNameID { createTempFileNameID() };
+
+    /// The keys of all the files in the cache, with the most recently used at the front.
+    std::list<std::string> recentlyUsed;
+
+    struct FileInfo
+    {
+        std::list<std::string>::iterator recentlyUsedPosition;
+        uint64_t size = 0;
+    };
+
+    std::unordered_map<std::string, FileInfo> files;
+    uint64_t totalBytes = 0;
+    bool journalNeedsSaving = false;
+
+    static constexpr uint32_t journalSaveIntervalMilliseconds = 10000;
+    choc::threading::TaskThread journalThread;
+
+    //==============================================================================
+    struct DurationHistogram
+    {
+        static constexpr uint32_t numBuckets = 160;   // quarter-octaves of nanoseconds
+
+        uint64_t counts[numBuckets] = {};
+        uint64_t maxNanoseconds = 0;
+
+        void add (uint64_t nanoseconds)
+        {
+            ++counts[DurationHistogramBuckets::getBucket (nanoseconds, numBuckets)];
+            maxNanoseconds = std::max (maxNanoseconds, nanoseconds);
+        }
+
+        double getPercentile (double proportion) const
+        {
+            return DurationHistogramBuckets::getPercentileSeconds (counts, numBuckets, proportion,
+                                                                   static_cast<double> (maxNanoseconds) * 1.0e-9);
+        }
+    };
+
+    mutable std::mutex statsLock;
+    Stats stats;
+    DurationHistogram storeTimes, reloadTimes;
+
+    static uint64_t getNanosecondsSince (std::chrono::steady_clock::time_point startTime)
+    {
+        return static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - startTime).count());
+    }
+
+    void recordStore (uint64_t numBytes, size_t numEvictions, std::chrono::steady_clock::time_point startTime)
+    {
+        auto nanoseconds = getNanosecondsSince (startTime);
+        std::lock_guard<decltype(statsLock)> l (statsLock);
+        stats.stores++;
+        stats.evictions += numEvictions;
+        stats.bytesWritten += numBytes;
+        storeTimes.add (nanoseconds);
+    }
+
+    void recordHit (uint64_t numBytes, std::chrono::steady_clock::time_point startTime)
+    {
+        auto nanoseconds = getNanosecondsSince (startTime);
+        std::lock_guard<decltype(statsLock)> l (statsLock);
+        stats.hits++;
+        stats.bytesRead += numBytes;
+        reloadTimes.add (nanoseconds);
+    }
+
+    void recordMiss()
+    {
+        std::lock_guard<decltype(statsLock)> l (statsLock);
+        stats.misses++;
+    }
 
-    static std::string getFileNamePrefix()   { return "cmajor_cache_"; }
+    static std::string getFileNamePrefix()       { return "cmajor_cache_"; }
+    static std::string getTempFileNamePrefix()   { return "cmajor_temp_"; }
+
+    // (this mustn't start with the same prefix as the cache files)
+    std::filesystem::path getJournalFile() const    { return folder / "cmajor_recently_used.txt"; }
 
     std::filesystem::path getCacheFile (const std::string& key)    { return folder / (getFileNamePrefix() + key); }
 
-    void removeOldFiles()
+    static std::string createTempFileNameID()
     {
-        std::lock_guard<decltype(lock)> l (lock);
+        std::random_device seed;
+        std::mt19937_64 random ((static_cast<uint64_t> (seed()) << 32) ^ seed());
+        return choc::text::createHexString (random());
+    }
+
+    /// Deletes any temp files that were left behind by an instance that was interrupted
+    /// part-way through a store. Another process may be in the middle of writing one, so
+    /// this only removes the ones that haven't been touched for a while.
+    void removeStaleTempFiles()
+    {
+        auto cutoffTime = std::filesystem::file_time_type::clock::now() - std::chrono::hours (1);
+
+        try
+        {
+            for (auto& f : std::filesystem::directory_iterator { folder })
+            {
+                std::error_code errorCode;
 
+                if (choc::text::startsWith (f.path().filename().string(), getTempFileNamePrefix())
+                     && f.last_write_time (errorCode) < cutoffTime && ! errorCode)
+                    std::filesystem::remove (f.path(), errorCode);
+            }
+        }
+        catch (...) {}
+    }
+
+   #if ! CHOC_WINDOWS
+    struct MappedFile  : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseMappedRegion, MappedFile>
+    {
+        MappedFile (void* d, uint64_t s) : data (d), size (s) {}
+        virtual ~MappedFile()       { ::munmap (data, static_cast<size_t> (size)); }
+
+        const void* getData() override     { return data; }
+        uint64_t getSize() override        { return size; }
+
+        void* data;
+        uint64_t size;
+    };
+   #endif
+
+    /// Called once at startup to build the list of existing files, ordered by their modification times
+    void scanExistingFiles()
+    {
         struct File
         {
-            std::filesystem::path file;
+            std::string key;
             std::filesystem::file_time_type time;
+            uint64_t size;
 
-            bool operator< (const File& other) const     { return time < other.time; }
+            bool operator< (const File& other) const     { return time > other.time; }
         };
 
-        std::vector<File> files;
+        std::vector<File> existingFiles;
 
-        for (auto& f : std::filesystem::directory_iterator { folder })
+        try
         {
-            if (choc::text::startsWith (f.path().stem().string(), getFileNamePrefix()))
+            for (auto& f : std::filesystem::directory_iterator { folder })
             {
-                try
+                auto name = f.path().filename().string();
+
+                if (choc::text::startsWith (name, getFileNamePrefix()))
                 {
-                    auto time = last_write_time (f.path());
-                    files.push_back ({ f.path(), time });
+                    try
+                    {
+                        existingFiles.push_back ({ name.substr (getFileNamePrefix().length()),
+                                                   last_write_time (f.path()),
+                                                   static_cast<uint64_t> (file_size (f.path())) });
+                    }
+                    catch (...) {}
                 }
-                catch (...) {}
             }
         }
+        catch (...) {}
 
-        std::sort (files.begin(), files.end());
+        std::sort (existingFiles.begin(), existingFiles.end());
 
-        if (files.size() > maxNumFiles)
+        for (auto& f : existingFiles)
         {
-            for (size_t i = 0; i < files.size() - maxNumFiles; ++i)
+            recentlyUsed.push_back (f.key);
+            files[f.key] = { std::prev (recentlyUsed.end()), f.size };
+            totalBytes += f.size;
+        }
+    }
+
+    /// Moves any keys listed in the journal to the front of the list, so that the order
+    /// in which they were last used takes precedence over the files' modification times.
+    void applyJournal()
+    {
+        try
+        {
+            // The journal lists the keys with the least recently used first
+            for (auto& key : choc::text::splitIntoLines (choc::file::loadFileAsString (getJournalFile().string()), false))
             {
-                try
-                {
-                    remove (files[i].file);
-                }
-                catch (...) {}
+                auto found = files.find (key);
+
+                if (found != files.end())
+                    recentlyUsed.splice (recentlyUsed.begin(), recentlyUsed, found->second.recentlyUsedPosition);
             }
         }
+        catch (...) {}
+    }
+
+    void saveJournalIfNeeded()
+    {
+        std::string content;
+
+        {
+            std::lock_guard<decltype(indexLock)> l (indexLock);
+
+            if (! journalNeedsSaving)
+                return;
+
+            journalNeedsSaving = false;
+
+            for (auto key = recentlyUsed.rbegin(); key != recentlyUsed.rend(); ++key)
+                content += *key + "\n";
+        }
+
+        try
+        {
+            choc::file::replaceFileWithContent (getJournalFile().string(), content);
+        }
+        catch (...) {}
+    }
+
+    void markAsUsed (const std::string& key, uint64_t size)
+    {
+        journalNeedsSaving = true;
+        auto found = files.find (key);
+
+        if (found != files.end())
+        {
+            recentlyUsed.splice (recentlyUsed.begin(), recentlyUsed, found->second.recentlyUsedPosition);
+            totalBytes = totalBytes - found->second.size + size;
+            found->second.size = size;
+            return;
+        }
+
+        recentlyUsed.push_front (key);
+        files[key] = { recentlyUsed.begin(), size };
+        totalBytes += size;
+    }
+
+    bool isOverLimit() const
+    {
+        return files.size() > maxNumFiles
+                || (maxTotalBytes != 0 && totalBytes > maxTotalBytes);
+    }
+
+    /// Drops the least-recently-used entries until the cache is within its limits,
+    /// and returns their keys so that the caller can delete the files.
+    std::vector<std::string> takeFilesToEvict()
+    {
+        std::vector<std::string> keys;
+
+        while (! recentlyUsed.empty() && isOverLimit())
+        {
+            auto found = files.find (recentlyUsed.back());
+            totalBytes -= found->second.size;
+            files.erase (found);
+            keys.push_back (std::move (recentlyUsed.back()));
+            recentlyUsed.pop_back();
+        }
+
+        return keys;
+    }
+
+    void removeFiles (const std::vector<std::string>& keys)
+    {
+        for (auto& key : keys)
+        {
+            std::error_code errorCode;
+            std::filesystem::remove (getCacheFile (key), errorCode);
+        }
     }
 };
 
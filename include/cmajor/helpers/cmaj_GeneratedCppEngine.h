@@ -22,6 +22,9 @@
 #pragma once
 
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
 #include "../API/cmaj_Engine.h"
 
 namespace cmaj
@@ -126,15 +129,132 @@ private:
     }
 
     //==============================================================================
-    struct Performer  : public choc::com::ObjectWithAtomicRefCount<PerformerInterface, Performer>
+    struct StreamFormat
+    {
+        EndpointHandle endpoint = {};
+        uint32_t numChannels = 0, bytesPerSample = 0;
+
+        uint32_t getFrameSize() const       { return numChannels * bytesPerSample; }
+    };
+
+    struct EndpointLayout
+    {
+        std::vector<StreamFormat> inputStreams, outputStreams;
+        std::unordered_map<EndpointHandle, std::vector<uint32_t>> inputEventSizes;
+        std::vector<EndpointHandle> outputEvents;
+        uint32_t largestInputEventSize = 0;
+    };
+
+    static const EndpointLayout& getEndpointLayout()
+    {
+        static const auto layout = []
+        {
+            EndpointLayout result;
+
+            auto getHandle = [] (const EndpointDetails& e)
+            {
+                return static_cast<EndpointHandle> (GeneratedCppClass::getEndpointHandleForName (e.endpointID.toString().c_str()));
+            };
+
+            auto getStreamFormat = [&] (const EndpointDetails& e)
+            {
+                auto& frameType = e.dataTypes.front();
+                auto sampleType = frameType.isVector() ? frameType.getElementType() : frameType;
+
+                return StreamFormat { getHandle (e),
+                                      frameType.isVector() ? frameType.getNumElements() : 1u,
+                                      static_cast<uint32_t> (sampleType.getValueDataSize()) };
+            };
+
+            try
+            {
+                auto details = choc::json::parse (GeneratedCppClass::programDetailsJSON);
+
+                for (auto& e : EndpointDetailsList::fromJSON (details["inputs"], true))
+                {
+                    if (e.isStream())
+                    {
+                        result.inputStreams.push_back (getStreamFormat (e));
+                    }
+                    else if (e.isEvent())
+                    {
+                        auto& sizes = result.inputEventSizes[getHandle (e)];
+
+                        for (auto& type : e.dataTypes)
+                        {
+                            sizes.push_back (static_cast<uint32_t> (type.getValueDataSize()));
+                            result.largestInputEventSize = std::max (result.largestInputEventSize, sizes.back());
+                        }
+                    }
+                }
+
+                for (auto& e : EndpointDetailsList::fromJSON (details["outputs"], false))
+                {
+                    if (e.isStream())
+                        result.outputStreams.push_back (getStreamFormat (e));
+                    else if (e.isEvent())
+                        result.outputEvents.push_back (getHandle (e));
+                }
+            }
+            catch (...) {}
+
+            return result;
+        }();
+
+        return layout;
+    }
+
+    //==============================================================================
+    struct Performer  : public choc::com::ObjectWithAtomicRefCount<ExtendedPerformerInterface, Performer>
     {
         Performer (int32_t sessionID, double frequency)
         {
             generatedObject.initialise (sessionID, frequency);
+            allocateBuffers();
+        }
+
+        /// Creates a copy of a prototype's state, without running the program's initialisation
+        Performer (const Performer& prototype)
+            : generatedObject (prototype.generatedObject),
+              currentBlockSize (prototype.currentBlockSize)
+        {
+            allocateBuffers();
         }
 
         virtual ~Performer() = default;
 
+        void allocateBuffers()
+        {
+            auto& layout = getEndpointLayout();
+            size_t largestFrameSize = 0;
+
+            for (auto& format : layout.inputStreams)
+                inputStreams.push_back ({ format, std::vector<char> (GeneratedCppClass::maxFramesPerBlock * format.getFrameSize()) });
+
+            for (auto& format : layout.outputStreams)
+            {
+                outputStreams.push_back ({ format, std::vector<char> (GeneratedCppClass::maxFramesPerBlock * format.getFrameSize()) });
+                largestFrameSize = std::max (largestFrameSize, static_cast<size_t> (format.getFrameSize()));
+            }
+
+            channelArrayScratch.resize (GeneratedCppClass::maxFramesPerBlock * largestFrameSize);
+
+            timedEvents.reserve (GeneratedCppClass::eventBufferSize);
+            timedEventData.reserve (GeneratedCppClass::eventBufferSize * layout.largestInputEventSize);
+
+            if constexpr (GeneratedCppClass::maxOutputEventSize != 0)
+            {
+                for (auto endpoint : layout.outputEvents)
+                {
+                    outputEventQueues.push_back ({ endpoint, {}, {} });
+                    outputEventQueues.back().events.reserve (GeneratedCppClass::eventBufferSize);
+                    outputEventQueues.back().data.resize (GeneratedCppClass::eventBufferSize * GeneratedCppClass::maxOutputEventSize);
+                }
+
+                mergePositions.resize (outputEventQueues.size());
+            }
+        }
+
         void setBlockSize (uint32_t numFramesForNextBlock) override
         {
             currentBlockSize = numFramesForNextBlock;
@@ -142,15 +262,138 @@ private:
 
         void advance() override
         {
-            generatedObject.advance (static_cast<int32_t> (currentBlockSize));
+            lastBlockWasSplit = false;
+            lastBlockSize = currentBlockSize;
+
+            for (auto& queue : outputEventQueues)
+                queue.events.clear();
+
+            if (timedEvents.empty())
+            {
+                renderFrames (0, currentBlockSize);
+            }
+            else
+            {
+                // The generated class can only deliver events at the start of a block, so to
+                // honour the event timestamps, we render the block in chunks that end at each one
+                lastBlockWasSplit = true;
+                size_t nextEvent = 0;
+
+                for (uint32_t start = 0; start < currentBlockSize;)
+                {
+                    while (nextEvent < timedEvents.size()
+                            && std::min (timedEvents[nextEvent].frame, currentBlockSize - 1) <= start)
+                    {
+                        auto& event = timedEvents[nextEvent++];
+                        generatedObject.addEvent (event.endpoint, event.typeIndex, timedEventData.data() + event.dataOffset);
+                    }
+
+                    auto end = nextEvent < timedEvents.size() ? std::min (timedEvents[nextEvent].frame, currentBlockSize - 1)
+                                                              : currentBlockSize;
+                    renderFrames (start, end - start);
+                    start = end;
+                }
+
+                timedEvents.clear();
+                timedEventData.clear();
+            }
+
+            for (auto& input : inputStreams)
+                input.hasFrames = false;
+
+            inputFramesWereSet = false;
+
+            for (auto& output : outputStreams)
+                output.hasFrames = lastBlockWasSplit;
+        }
+
+        void process (const BlockDescriptor& block) override
+        {
+            setBlockSize (block.numFrames);
+
+            for (uint32_t i = 0; i < block.numStreamInputs; ++i)
+            {
+                auto& input = block.streamInputs[i];
+                setInputFrames (input.endpoint, input.frameData, block.numFrames);
+            }
+
+            for (uint32_t i = 0; i < block.numEventInputs; ++i)
+            {
+                auto& event = block.eventInputs[i];
+                generatedObject.addEvent (event.endpoint, event.typeIndex, event.eventData);
+            }
+
+            for (uint32_t i = 0; i < block.numValueInputs; ++i)
+            {
+                auto& value = block.valueInputs[i];
+                generatedObject.setValue (value.endpoint, value.valueData, static_cast<int32_t> (value.numFramesToReachValue));
+            }
+
+            advance();
+
+            for (uint32_t i = 0; i < block.numStreamOutputs; ++i)
+            {
+                auto& output = block.streamOutputs[i];
+                copyOutputFrames (output.endpoint, output.destData, block.numFrames);
+            }
         }
 
         void setInputFrames (EndpointHandle endpoint, const void* frameData, uint32_t numFrames) override
         {
+            // The frames only need to be kept if the block is going to be split at a timed
+            // event, otherwise they can go straight to the generated class
+            if (! timedEvents.empty())
+            {
+                if (auto input = findStream (inputStreams, endpoint))
+                {
+                    CMAJ_ASSERT (numFrames <= GeneratedCppClass::maxFramesPerBlock);
+                    std::memcpy (input->frames.data(), frameData, numFrames * input->format.getFrameSize());
+                    input->numFrames = numFrames;
+                    input->hasFrames = true;
+                    return;
+                }
+            }
+
+            inputFramesWereSet = true;
             generatedObject.setInputFrames (endpoint, frameData, numFrames,
                                             currentBlockSize > numFrames ? currentBlockSize - numFrames : 0);
         }
 
+        void setInputFramesFromChannelArray (EndpointHandle endpoint, const void* const* channelData,
+                                             uint32_t numChannels, uint32_t numFrames) override
+        {
+            // a mono stream has the same layout whether it's interleaved or not
+            if (numChannels == 1)
+                return setInputFrames (endpoint, channelData[0], numFrames);
+
+            if (auto input = findStream (inputStreams, endpoint))
+            {
+                auto bytesPerSample = input->format.bytesPerSample;
+                CMAJ_ASSERT (numChannels == input->format.numChannels && numFrames <= GeneratedCppClass::maxFramesPerBlock);
+                auto dest = input->frames.data();
+
+                for (uint32_t frame = 0; frame < numFrames; ++frame)
+                {
+                    for (uint32_t chan = 0; chan < numChannels; ++chan)
+                    {
+                        std::memcpy (dest, static_cast<const char*> (channelData[chan]) + frame * bytesPerSample, bytesPerSample);
+                        dest += bytesPerSample;
+                    }
+                }
+
+                if (timedEvents.empty())
+                {
+                    inputFramesWereSet = true;
+                    generatedObject.setInputFrames (endpoint, input->frames.data(), numFrames,
+                                                    currentBlockSize > numFrames ? currentBlockSize - numFrames : 0);
+                    return;
+                }
+
+                input->numFrames = numFrames;
+                input->hasFrames = true;
+            }
+        }
+
         void setInputValue (EndpointHandle endpoint, const void* valueData, uint32_t numFramesToReachValue) override
         {
             generatedObject.setValue (endpoint, valueData, static_cast<int32_t> (numFramesToReachValue));
@@ -161,6 +404,43 @@ private:
             generatedObject.addEvent (endpoint, typeIndex, eventData);
         }
 
+        void addTimestampedInputEvent (EndpointHandle endpoint, uint32_t typeIndex, uint32_t frameOffset, const void* eventData) override
+        {
+            if (frameOffset == 0)
+                return generatedObject.addEvent (endpoint, typeIndex, eventData);
+
+            // If some input frames have already gone to the generated class, the block can't be
+            // split any more, so an event that was added too late is delivered at its start, and
+            // counted as an xrun so that the caller can find out that it wasn't sample-accurate
+            if (inputFramesWereSet)
+            {
+                ++xruns;
+                return generatedObject.addEvent (endpoint, typeIndex, eventData);
+            }
+
+            auto& sizes = getEndpointLayout().inputEventSizes;
+            auto found = sizes.find (endpoint);
+
+            if (found == sizes.end() || typeIndex >= found->second.size())
+                return;
+
+            auto dataSize = found->second[typeIndex];
+
+            if (timedEvents.size() >= GeneratedCppClass::eventBufferSize
+                 || timedEventData.size() + dataSize > GeneratedCppClass::eventBufferSize * getEndpointLayout().largestInputEventSize)
+            {
+                ++xruns;
+                return;
+            }
+
+            // events normally arrive in order, so this insertion will usually be at the end
+            auto insertPos = std::upper_bound (timedEvents.begin(), timedEvents.end(), frameOffset,
+                                               [] (uint32_t frame, const TimedEvent& e) { return frame < e.frame; });
+
+            timedEvents.insert (insertPos, { frameOffset, endpoint, typeIndex, static_cast<uint32_t> (timedEventData.size()) });
+            timedEventData.insert (timedEventData.end(), static_cast<const char*> (eventData), static_cast<const char*> (eventData) + dataSize);
+        }
+
         void copyOutputValue (EndpointHandle endpoint, void* dest) override
         {
             generatedObject.copyOutputValue (endpoint, dest);
@@ -168,13 +448,82 @@ private:
 
         void copyOutputFrames (EndpointHandle endpoint, void* dest, uint32_t numFramesToCopy) override
         {
-            generatedObject.copyOutputFrames (endpoint, dest, numFramesToCopy);
+            if (auto output = findStream (outputStreams, endpoint); output != nullptr && output->hasFrames)
+                std::memcpy (dest, output->frames.data(), numFramesToCopy * output->format.getFrameSize());
+            else
+                generatedObject.copyOutputFrames (endpoint, dest, numFramesToCopy);
+        }
+
+        void copyOutputFramesToChannelArray (EndpointHandle endpoint, void* const* channelDest,
+                                             uint32_t numChannels, uint32_t numFramesToCopy) override
+        {
+            if (numChannels == 1)
+                return copyOutputFrames (endpoint, channelDest[0], numFramesToCopy);
+
+            if (auto output = findStream (outputStreams, endpoint))
+            {
+                auto bytesPerSample = output->format.bytesPerSample;
+                CMAJ_ASSERT (numChannels == output->format.numChannels && numFramesToCopy <= GeneratedCppClass::maxFramesPerBlock);
+                copyOutputFrames (endpoint, channelArrayScratch.data(), numFramesToCopy);
+                auto source = channelArrayScratch.data();
+
+                for (uint32_t frame = 0; frame < numFramesToCopy; ++frame)
+                {
+                    for (uint32_t chan = 0; chan < numChannels; ++chan)
+                    {
+                        std::memcpy (static_cast<char*> (channelDest[chan]) + frame * bytesPerSample, source, bytesPerSample);
+                        source += bytesPerSample;
+                    }
+                }
+            }
+        }
+
+        const void* getOutputFramesPointer (EndpointHandle endpoint) override
+        {
+            if (auto output = findStream (outputStreams, endpoint))
+            {
+                // This isn't zero-copy: the generated class only provides access to its output
+                // streams by copying them, so unless the last block was split up and the frames are
+                // already in our own buffer, they get copied there the first time they're asked for
+                if (! output->hasFrames)
+                {
+                    generatedObject.copyOutputFrames (endpoint, output->frames.data(), lastBlockSize);
+                    output->hasFrames = true;
+                }
+
+                return output->frames.data();
+            }
+
+            return nullptr;
         }
 
         void iterateOutputEvents (EndpointHandle endpoint, void* context, PerformerInterface::HandleOutputEventCallback callback) override
         {
             if constexpr (GeneratedCppClass::maxOutputEventSize != 0)
             {
+                if (lastBlockWasSplit)
+                {
+                    for (auto& queue : outputEventQueues)
+                    {
+                        if (queue.endpoint == endpoint)
+                        {
+                            for (size_t i = 0; i < queue.events.size(); ++i)
+                            {
+                                auto& event = queue.events[i];
+
+                                if (! callback (context, endpoint, event.typeIndex, event.frame,
+                                                queue.data.data() + i * GeneratedCppClass::maxOutputEventSize, event.dataSize))
+                                    break;
+                            }
+
+                            queue.events.clear();
+                            return;
+                        }
+                    }
+
+                    return;
+                }
+
                 if (auto numEvents = generatedObject.getNumOutputEvents (endpoint))
                 {
                     if (numEvents > GeneratedCppClass::eventBufferSize)
@@ -199,6 +548,89 @@ private:
             }
         }
 
+        // The generated class holds all of its state as plain data members, so if the
+        // compiler agrees that it's trivially copyable, a snapshot is just a copy of it
+        static constexpr bool canCopyState = std::is_trivially_copyable<GeneratedCppClass>::value;
+
+        size_t getStateSize() override
+        {
+            return canCopyState ? sizeof (GeneratedCppClass) : 0;
+        }
+
+        bool saveState (void* dest) override
+        {
+            if constexpr (canCopyState)
+            {
+                std::memcpy (dest, std::addressof (generatedObject), sizeof (GeneratedCppClass));
+                return true;
+            }
+
+            return false;
+        }
+
+        bool restoreState (const void* source) override
+        {
+            if constexpr (canCopyState)
+            {
+                std::memcpy (std::addressof (generatedObject), source, sizeof (GeneratedCppClass));
+                return true;
+            }
+
+            return false;
+        }
+
+        PerformerInterface* clone() override
+        {
+            if constexpr (std::is_copy_constructible<GeneratedCppClass>::value)
+                return choc::com::create<Performer> (*this).getWithIncrementedRefCount();
+
+            return {};
+        }
+
+        void iterateAllOutputEvents (void* context, PerformerInterface::HandleOutputEventCallback callback) override
+        {
+            if constexpr (GeneratedCppClass::maxOutputEventSize != 0)
+            {
+                if (! lastBlockWasSplit)
+                    queueOutputEvents (0);
+
+                // Each queue is already in frame order, so this just needs to merge them
+                for (auto& pos : mergePositions)
+                    pos = 0;
+
+                for (;;)
+                {
+                    OutputEventQueue* nextQueue = nullptr;
+                    size_t nextQueueIndex = 0;
+
+                    for (size_t i = 0; i < outputEventQueues.size(); ++i)
+                    {
+                        auto& queue = outputEventQueues[i];
+
+                        if (mergePositions[i] < queue.events.size()
+                             && (nextQueue == nullptr || queue.events[mergePositions[i]].frame < nextQueue->events[mergePositions[nextQueueIndex]].frame))
+                        {
+                            nextQueue = std::addressof (queue);
+                            nextQueueIndex = i;
+                        }
+                    }
+
+                    if (nextQueue == nullptr)
+                        break;
+
+                    auto index = mergePositions[nextQueueIndex]++;
+                    auto& event = nextQueue->events[index];
+
+                    if (! callback (context, nextQueue->endpoint, event.typeIndex, event.frame,
+                                    nextQueue->data.data() + index * GeneratedCppClass::maxOutputEventSize, event.dataSize))
+                        break;
+                }
+
+                for (auto& queue : outputEventQueues)
+                    queue.events.clear();
+            }
+        }
+
         const char* getStringForHandle (uint32_t handle, size_t& stringLength) override
         {
             return generatedObject.getStringForHandle (handle, stringLength);
@@ -211,9 +643,111 @@ private:
         double getLatency() override            { return GeneratedCppClass::latency; }
         uint32_t getEventBufferSize() override  { return GeneratedCppClass::eventBufferSize; }
 
+        //==============================================================================
+        struct StreamBuffer
+        {
+            StreamFormat format;
+            std::vector<char> frames;
+            uint32_t numFrames = 0;
+            bool hasFrames = false;
+        };
+
+        struct TimedEvent
+        {
+            uint32_t frame;
+            EndpointHandle endpoint;
+            uint32_t typeIndex, dataOffset;
+        };
+
+        struct QueuedOutputEvent
+        {
+            uint32_t frame, typeIndex, dataSize;
+        };
+
+        struct OutputEventQueue
+        {
+            EndpointHandle endpoint;
+            std::vector<QueuedOutputEvent> events;
+            std::vector<uint8_t> data;
+        };
+
         GeneratedCppClass generatedObject;
-        uint32_t currentBlockSize = 1;
+        uint32_t currentBlockSize = 1, lastBlockSize = 0;
         uint32_t xruns = 0;
+        bool lastBlockWasSplit = false, inputFramesWereSet = false;
+        std::vector<StreamBuffer> inputStreams, outputStreams;
+        std::vector<TimedEvent> timedEvents;
+        std::vector<char> timedEventData, channelArrayScratch;
+        std::vector<OutputEventQueue> outputEventQueues;
+        std::vector<size_t> mergePositions;
+
+        static StreamBuffer* findStream (std::vector<StreamBuffer>& streams, EndpointHandle endpoint)
+        {
+            for (auto& s : streams)
+                if (s.format.endpoint == endpoint)
+                    return std::addressof (s);
+
+            return nullptr;
+        }
+
+        void renderFrames (uint32_t start, uint32_t numFrames)
+        {
+            for (auto& input : inputStreams)
+            {
+                if (input.hasFrames)
+                {
+                    auto numAvailable = input.numFrames > start ? std::min (numFrames, input.numFrames - start) : 0u;
+
+                    generatedObject.setInputFrames (input.format.endpoint,
+                                                    input.frames.data() + start * input.format.getFrameSize(),
+                                                    numAvailable, numFrames - numAvailable);
+                }
+            }
+
+            generatedObject.advance (static_cast<int32_t> (numFrames));
+
+            if (lastBlockWasSplit)
+            {
+                for (auto& output : outputStreams)
+                    generatedObject.copyOutputFrames (output.format.endpoint,
+                                                      output.frames.data() + start * output.format.getFrameSize(),
+                                                      numFrames);
+
+                queueOutputEvents (start);
+            }
+        }
+
+        /// Moves any events from the generated object's output endpoints into our own queues
+        void queueOutputEvents (uint32_t frameOffset)
+        {
+            if constexpr (GeneratedCppClass::maxOutputEventSize != 0)
+            {
+                for (auto& queue : outputEventQueues)
+                {
+                    auto numEvents = generatedObject.getNumOutputEvents (queue.endpoint);
+
+                    for (uint32_t i = 0; i < numEvents; ++i)
+                    {
+                        // the queue's data buffer only has room for eventBufferSize events in total,
+                        // however many chunks the block was split into
+                        if (queue.events.size() >= GeneratedCppClass::eventBufferSize)
+                        {
+                            ++xruns;
+                            break;
+                        }
+
+                        auto data = queue.data.data() + queue.events.size() * GeneratedCppClass::maxOutputEventSize;
+                        auto frame = generatedObject.readOutputEvent (queue.endpoint, i, data);
+                        auto type = generatedObject.getOutputEventType (queue.endpoint, i);
+
+                        queue.events.push_back ({ frameOffset + static_cast<uint32_t> (frame), type,
+                                                  static_cast<uint32_t> (generatedObject.getOutputEventDataSize (queue.endpoint, type)) });
+                    }
+
+                    generatedObject.resetOutputEventCount (queue.endpoint);
+                }
+            }
+        }
     };
 };
 
@@ -223,9 +757,7 @@ private:
 template <typename GeneratedCppClass>
 Engine createEngineForGeneratedCppProgram()
 {
-    Engine e;
-    e.engine = choc::com::create<GeneratedCppEngine<GeneratedCppClass>>();
-    return e;
+    return Engine (EnginePtr (choc::com::create<GeneratedCppEngine<GeneratedCppClass>>().getWithIncrementedRefCount()));
 }
 
 
@@ -0,0 +1,225 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "../COM/cmaj_CacheDatabaseInterface.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// A CacheDatabaseInterface which keeps recently-used entries in memory, in front
+/// of another (usually disk-based) cache.
+///
+/// Stores are written through to the backing cache as well as being kept in memory.
+/// Reloads are served from memory if possible, and otherwise fetched from the backing
+/// cache and kept. When the total size of the entries in memory goes over the limit,
+/// the least-recently-used ones are dropped. You can also use it without a backing
+/// cache, as a purely in-memory store.
+///
+/// If an entry isn't in memory, reloadMapped() passes the request on to the backing
+/// cache, but the mapped data isn't copied into memory, as that would defeat the point
+/// of mapping it.
+///
+struct MemoryCacheDatabase   : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseInterface, MemoryCacheDatabase>
+{
+    MemoryCacheDatabase (CacheDatabaseInterface::Ptr backingCache, uint64_t maxBytesInMemory)
+        : target (std::move (backingCache)), maxBytes (maxBytesInMemory)
+    {}
+
+    virtual ~MemoryCacheDatabase() = default;
+
+    void store (const char* key, const void* dataToSave, uint64_t dataSize) override
+    {
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            add (key, dataToSave, dataSize);
+        }
+
+        if (target != nullptr)
+            target->store (key, dataToSave, dataSize);
+    }
+
+    uint64_t reload (const char* key, void* destAddress, uint64_t destSize) override
+    {
+        // Calls that just ask for the size of an entry aren't counted as hits or misses
+        bool isFetch = destAddress != nullptr;
+
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+
+            if (auto entry = find (key))
+            {
+                auto size = static_cast<uint64_t> (entry->data.size());
+
+                if (isFetch)
+                    counters.hits++;
+
+                if (isFetch && destSize >= size)
+                    std::memcpy (destAddress, entry->data.data(), entry->data.size());
+
+                return size;
+            }
+
+            if (isFetch)
+                counters.misses++;
+        }
+
+        if (target == nullptr)
+            return 0;
+
+        auto size = target->reload (key, destAddress, destSize);
+
+        if (size != 0 && destAddress != nullptr && destSize >= size)
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            add (key, destAddress, size);
+        }
+
+        return size;
+    }
+
+    CacheDatabaseMappedRegion* reloadMapped (const char* key) override
+    {
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+
+            // An entry that's already in memory is quicker to copy with reload() than to map
+            if (entries.find (key) != entries.end())
+                return nullptr;
+        }
+
+        if (target == nullptr)
+            return nullptr;
+
+        auto region = target->reloadMapped (key);
+
+        if (region != nullptr)
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+            counters.misses++;
+        }
+
+        return region;
+    }
+
+    //==============================================================================
+    struct Counters
+    {
+        uint64_t hits = 0, misses = 0, evictions = 0;
+        uint64_t numEntries = 0, bytesInMemory = 0;
+    };
+
+    /// Returns the number of hits, misses and evictions since the cache was created
+    /// or resetCounters() was called, and the current amount of data held in memory.
+    Counters getCounters() const
+    {
+        std::lock_guard<decltype(lock)> l (lock);
+        auto c = counters;
+        c.numEntries = entries.size();
+        c.bytesInMemory = totalBytes;
+        return c;
+    }
+
+    void resetCounters()
+    {
+        std::lock_guard<decltype(lock)> l (lock);
+        counters = {};
+    }
+
+    /// Drops everything that's held in memory, without affecting the backing cache.
+    void clear()
+    {
+        std::lock_guard<decltype(lock)> l (lock);
+        entries.clear();
+        recentlyUsed.clear();
+        totalBytes = 0;
+    }
+
+private:
+    CacheDatabaseInterface::Ptr target;
+    uint64_t maxBytes;
+
+    struct Entry
+    {
+        std::vector<uint8_t> data;
+        std::list<std::string>::iterator recentlyUsedPosition;
+    };
+
+    mutable std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> recentlyUsed; // most recently used first
+    uint64_t totalBytes = 0;
+    Counters counters;
+
+    Entry* find (const std::string& key)
+    {
+        auto found = entries.find (key);
+
+        if (found == entries.end())
+            return nullptr;
+
+        recentlyUsed.splice (recentlyUsed.begin(), recentlyUsed, found->second.recentlyUsedPosition);
+        return std::addressof (found->second);
+    }
+
+    void add (const std::string& key, const void* data, uint64_t size)
+    {
+        remove (key);
+
+        // If it's too big to ever fit, there's no point evicting everything else for it
+        if (size == 0 || size > maxBytes)
+            return;
+
+        while (totalBytes + size > maxBytes && ! recentlyUsed.empty())
+        {
+            remove (recentlyUsed.back());
+            counters.evictions++;
+        }
+
+        recentlyUsed.push_front (key);
+
+        auto& entry = entries[key];
+        entry.data.assign (static_cast<const uint8_t*> (data), static_cast<const uint8_t*> (data) + size);
+        entry.recentlyUsedPosition = recentlyUsed.begin();
+        totalBytes += size;
+    }
+
+    void remove (std::string key)
+    {
+        auto found = entries.find (key);
+
+        if (found != entries.end())
+        {
+            totalBytes -= found->second.data.size();
+            recentlyUsed.erase (found->second.recentlyUsedPosition);
+            entries.erase (found);
+        }
+    }
+};
+
+} // namespace cmaj
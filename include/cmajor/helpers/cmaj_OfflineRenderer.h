@@ -0,0 +1,310 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <functional>
+#include "../API/cmaj_Performer.h"
+#include "../../choc/containers/choc_NonAllocatingStableSort.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// Renders any number of frames through a Performer in one call, for offline and
+/// batch-processing jobs.
+///
+/// You attach whole input and output buffers to the stream endpoints, queue up any
+/// events and value changes with the frame at which they should happen, and then
+/// call render(). It takes care of splitting the job into the largest blocks that
+/// the performer allows, and uses timestamped events so that they land on the right
+/// frame without having to chop the blocks up any further. (Value changes do need
+/// a block boundary, so the block is split at any frame where a value changes, and
+/// if the performer doesn't support timestamped events, it's split at events too.)
+///
+struct OfflineRenderer
+{
+    OfflineRenderer (Performer);
+
+    /// Attaches a buffer of input frames to a stream endpoint. The buffer must stay valid
+    /// until render() has finished, and its format must match the endpoint's.
+    template <typename SampleType>
+    void addStreamInput (EndpointHandle, const choc::buffer::InterleavedView<SampleType>&);
+
+    /// Attaches a buffer of input frames to a stream endpoint. The buffer must stay valid
+    /// until render() has finished, and its format must match the endpoint's.
+    template <typename SampleType>
+    void addStreamInput (EndpointHandle, const choc::buffer::ChannelArrayView<SampleType>&);
+
+    /// Attaches a buffer that will receive the frames from an output stream endpoint. The buffer
+    /// must stay valid until render() has finished, and its format must match the endpoint's.
+    template <typename SampleType>
+    void addStreamOutput (EndpointHandle, const choc::buffer::InterleavedView<SampleType>&);
+
+    /// Attaches a buffer that will receive the frames from an output stream endpoint. The buffer
+    /// must stay valid until render() has finished, and its format must match the endpoint's.
+    template <typename SampleType>
+    void addStreamOutput (EndpointHandle, const choc::buffer::ChannelArrayView<SampleType>&);
+
+    /// Queues an event to be sent to an input endpoint at the given frame of the render.
+    /// The value's type must match the endpoint type that the typeIndex selects.
+    void addEvent (uint64_t frame, EndpointHandle, uint32_t typeIndex, const choc::value::ValueView&);
+
+    /// Queues a value change for an input value endpoint at the given frame of the render.
+    /// The value's type must match the endpoint's type.
+    void addValue (uint64_t frame, EndpointHandle, const choc::value::ValueView&, uint32_t numFramesToReachValue);
+
+    /// If this is set, it will be called with any events that the performer's output event
+    /// endpoints emit, in frame order.
+    std::function<void(uint64_t frame, EndpointHandle, uint32_t typeIndex, const void* data, uint32_t dataSize)> handleOutputEvent;
+
+    /// A performer that doesn't support extended operations can't report the events from all
+    /// its endpoints at once, so for one of those, handleOutputEvent will only be called for
+    /// the endpoints that have been registered with this method.
+    void addEventOutput (EndpointHandle);
+
+    /// Renders the given number of frames, starting at frame 0 of the attached buffers.
+    /// Any input buffers that are shorter than this are treated as silent beyond their end,
+    /// and output beyond the end of an output buffer is discarded.
+    /// The queued events and value changes are used up by this call.
+    void render (uint64_t totalFramesToRender);
+
+    Performer performer;
+
+private:
+    //==============================================================================
+    using TransferFn = std::function<void(Performer&, uint64_t startFrame, uint32_t numFrames)>;
+
+    struct QueuedEvent
+    {
+        uint64_t frame;
+        EndpointHandle endpoint;
+        uint32_t typeIndex;
+        choc::value::Value value;
+    };
+
+    struct QueuedValue
+    {
+        uint64_t frame;
+        EndpointHandle endpoint;
+        choc::value::Value value;
+        uint32_t numFramesToReachValue;
+    };
+
+    struct OutputEvent
+    {
+        uint32_t frame;
+        EndpointHandle endpoint;
+        uint32_t typeIndex;
+        std::vector<char> data;
+    };
+
+    std::vector<TransferFn> inputTransfers, outputTransfers;
+    std::vector<QueuedEvent> events;
+    std::vector<QueuedValue> values;
+    std::vector<EndpointHandle> eventOutputs;
+    std::vector<OutputEvent> outputEvents;
+
+    void dispatchOutputEvents (uint64_t startFrame);
+
+    template <typename ViewType>
+    static ViewType getAvailableFrames (const ViewType&, uint64_t startFrame, uint32_t numFrames);
+};
+
+
+
+//==============================================================================
+//        _        _           _  _
+//     __| |  ___ | |_   __ _ (_)| | ___
+//    / _` | / _ \| __| / _` || || |/ __|
+//   | (_| ||  __/| |_ | (_| || || |\__ \ _  _  _
+//    \__,_| \___| \__| \__,_||_||_||___/(_)(_)(_)
+//
+//   Code beyond this point is implementation detail...
+//
+//==============================================================================
+
+inline OfflineRenderer::OfflineRenderer (Performer p) : performer (std::move (p))
+{
+    CMAJ_ASSERT (performer != nullptr);
+}
+
+template <typename ViewType>
+ViewType OfflineRenderer::getAvailableFrames (const ViewType& view, uint64_t startFrame, uint32_t numFrames)
+{
+    auto totalFrames = static_cast<uint64_t> (view.getNumFrames());
+
+    if (startFrame >= totalFrames)
+        return view.getFrameRange ({ 0, 0 });
+
+    auto end = std::min (totalFrames, startFrame + numFrames);
+    return view.getFrameRange ({ static_cast<choc::buffer::FrameCount> (startFrame),
+                                 static_cast<choc::buffer::FrameCount> (end) });
+}
+
+template <typename SampleType>
+void OfflineRenderer::addStreamInput (EndpointHandle endpoint, const choc::buffer::InterleavedView<SampleType>& source)
+{
+    inputTransfers.push_back ([endpoint, source] (Performer& p, uint64_t start, uint32_t numFrames)
+    {
+        p.setInputFrames (endpoint, getAvailableFrames (source, start, numFrames));
+    });
+}
+
+template <typename SampleType>
+void OfflineRenderer::addStreamInput (EndpointHandle endpoint, const choc::buffer::ChannelArrayView<SampleType>& source)
+{
+    inputTransfers.push_back ([endpoint, source] (Performer& p, uint64_t start, uint32_t numFrames)
+    {
+        p.setInputFrames (endpoint, getAvailableFrames (source, start, numFrames));
+    });
+}
+
+template <typename SampleType>
+void OfflineRenderer::addStreamOutput (EndpointHandle endpoint, const choc::buffer::InterleavedView<SampleType>& dest)
+{
+    outputTransfers.push_back ([endpoint, dest] (Performer& p, uint64_t start, uint32_t numFrames)
+    {
+        if (auto available = getAvailableFrames (dest, start, numFrames); available.getNumFrames() != 0)
+            p.copyOutputFrames (endpoint, available);
+    });
+}
+
+template <typename SampleType>
+void OfflineRenderer::addStreamOutput (EndpointHandle endpoint, const choc::buffer::ChannelArrayView<SampleType>& dest)
+{
+    outputTransfers.push_back ([endpoint, dest] (Performer& p, uint64_t start, uint32_t numFrames)
+    {
+        if (auto available = getAvailableFrames (dest, start, numFrames); available.getNumFrames() != 0)
+            p.copyOutputFrames (endpoint, available);
+    });
+}
+
+inline void OfflineRenderer::addEvent (uint64_t frame, EndpointHandle endpoint, uint32_t typeIndex, const choc::value::ValueView& value)
+{
+    events.push_back ({ frame, endpoint, typeIndex, choc::value::Value (value) });
+}
+
+inline void OfflineRenderer::addValue (uint64_t frame, EndpointHandle endpoint, const choc::value::ValueView& value, uint32_t numFramesToReachValue)
+{
+    values.push_back ({ frame, endpoint, choc::value::Value (value), numFramesToReachValue });
+}
+
+inline void OfflineRenderer::addEventOutput (EndpointHandle endpoint)
+{
+    eventOutputs.push_back (endpoint);
+}
+
+inline void OfflineRenderer::dispatchOutputEvents (uint64_t startFrame)
+{
+    auto handler = [this, startFrame] (EndpointHandle h, uint32_t typeIndex, uint32_t frameOffset,
+                                       const void* data, uint32_t dataSize) -> bool
+    {
+        handleOutputEvent (startFrame + frameOffset, h, typeIndex, data, dataSize);
+        return true;
+    };
+
+    if (performer.iterateAllOutputEvents (handler))
+        return;
+
+    // Without the performer's help, the events from each endpoint have to be gathered and sorted
+    outputEvents.clear();
+
+    for (auto endpoint : eventOutputs)
+    {
+        performer.iterateOutputEvents (endpoint, [this] (EndpointHandle h, uint32_t typeIndex, uint32_t frameOffset,
+                                                         const void* data, uint32_t dataSize) -> bool
+        {
+            auto d = static_cast<const char*> (data);
+            outputEvents.push_back ({ frameOffset, h, typeIndex, std::vector<char> (d, d + dataSize) });
+            return true;
+        });
+    }
+
+    choc::sorting::stable_sort (outputEvents.begin(), outputEvents.end(), [] (const OutputEvent& a, const OutputEvent& b) { return a.frame < b.frame; });
+
+    for (auto& e : outputEvents)
+        handler (e.endpoint, e.typeIndex, e.frame, e.data.data(), static_cast<uint32_t> (e.data.size()));
+}
+
+inline void OfflineRenderer::render (uint64_t totalFramesToRender)
+{
+    choc::sorting::stable_sort (events.begin(), events.end(), [] (const QueuedEvent& a, const QueuedEvent& b) { return a.frame < b.frame; });
+    choc::sorting::stable_sort (values.begin(), values.end(), [] (const QueuedValue& a, const QueuedValue& b) { return a.frame < b.frame; });
+
+    auto maxBlockSize = static_cast<uint64_t> (performer.getMaximumBlockSize());
+    auto canUseTimestampedEvents = performer.supportsExtendedOperations();
+    size_t nextEvent = 0, nextValue = 0;
+
+    for (uint64_t start = 0; start < totalFramesToRender;)
+    {
+        auto end = std::min (totalFramesToRender, start + maxBlockSize);
+
+        for (; nextValue < values.size() && values[nextValue].frame <= start; ++nextValue)
+            performer.setInputValue (values[nextValue].endpoint, values[nextValue].value, values[nextValue].numFramesToReachValue);
+
+        // a value change has to happen at the start of a block
+        if (nextValue < values.size())
+            end = std::min (end, values[nextValue].frame);
+
+        // ..and so does an event, if the performer can't take a frame offset for it
+        if (! canUseTimestampedEvents)
+        {
+            for (auto i = nextEvent; i < events.size() && events[i].frame < end; ++i)
+            {
+                if (events[i].frame > start)
+                {
+                    end = events[i].frame;
+                    break;
+                }
+            }
+        }
+
+        auto numFrames = static_cast<uint32_t> (end - start);
+        performer.setBlockSize (numFrames);
+
+        // timestamped events have to be added before the block's input frames
+        for (; nextEvent < events.size() && events[nextEvent].frame < end; ++nextEvent)
+        {
+            auto& e = events[nextEvent];
+            auto frameOffset = e.frame > start ? static_cast<uint32_t> (e.frame - start) : 0u;
+            performer.addInputEvent (e.endpoint, e.typeIndex, frameOffset, e.value);
+        }
+
+        for (auto& transfer : inputTransfers)
+            transfer (performer, start, numFrames);
+
+        performer.advance();
+
+        for (auto& transfer : outputTransfers)
+            transfer (performer, start, numFrames);
+
+        if (handleOutputEvent)
+            dispatchOutputEvents (start);
+
+        start = end;
+    }
+
+    events.clear();
+    values.clear();
+}
+
+} // namespace cmaj
@@ -0,0 +1,484 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <fstream>
+#include <list>
+#include <unordered_map>
+#include "../../choc/threading/choc_TaskThread.h"
+#include "../COM/cmaj_CacheDatabaseInterface.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// An implementation of CacheDatabaseInterface which keeps all of its entries
+/// in a single append-only file, rather than one file per entry.
+///
+/// When it's created, it scans the file to build an in-memory index, so lookups
+/// don't touch the filesystem until the data itself is read. When the total size of
+/// the live entries goes over the given limit, the least-recently-used ones are
+/// dropped, and once enough of the file is taken up by old or dropped entries, a
+/// background thread compacts it by writing the live entries into a new file and
+/// renaming it over the old one.
+///
+/// Each record is checksummed, and if the app dies part-way through writing one,
+/// the incomplete record will be discarded the next time the file is opened.
+///
+/// The file uses the machine's native byte order, so it's intended to be a local
+/// cache rather than something to share between machines. It also doesn't take any
+/// kind of lock on the file, so only one PackedFileCacheDatabase in one process should
+/// use a given file at a time.
+///
+struct PackedFileCacheDatabase   : public choc::com::ObjectWithAtomicRefCount<CacheDatabaseInterface, PackedFileCacheDatabase>
+{
+    /// If maxTotalBytesAllowed is 0, there's no limit on the total size of the entries.
+    PackedFileCacheDatabase (std::filesystem::path fileToUse, uint64_t maxTotalBytesAllowed)
+       : file (std::move (fileToUse)), maxTotalBytes (maxTotalBytesAllowed)
+    {
+        std::lock_guard<decltype(lock)> l (lock);
+        openFile();
+        loadIndex();
+        compactionThread.start (0, [this] { compactIfNeeded(); });
+    }
+
+    virtual ~PackedFileCacheDatabase() = default;
+
+    void store (const char* key, const void* dataToSave, uint64_t dataSize) override
+    {
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+
+            if (! stream.is_open())
+                return;
+
+            std::string_view keyString (key);
+
+            RecordHeader header;
+            header.keyLength = static_cast<uint32_t> (keyString.length());
+            header.dataSize = dataSize;
+            header.checksum = calculateChecksum (dataToSave, dataSize);
+
+            auto recordStart = fileSize;
+
+            if (! appendRecord (header, keyString, dataToSave))
+                return;
+
+            removeFromIndex (index.find (std::string (keyString)));
+            addToIndex (std::string (keyString), recordStart, dataSize, header.checksum);
+
+            while (maxTotalBytes != 0 && liveDataBytes > maxTotalBytes && lruOrder.size() > 1)
+                evict (lruOrder.back());
+        }
+
+        compactionThread.trigger();
+    }
+
+    uint64_t reload (const char* key, void* destAddress, uint64_t destSize) override
+    {
+        // Records are never modified once they've been written, so the data is read through
+        // a separate stream without holding the lock. If the file gets compacted or the entry
+        // replaced during the read, the offset may have been stale, so it tries again.
+        for (int attempt = 0; attempt < maxReloadAttempts; ++attempt)
+        {
+            uint64_t recordOffset = 0, dataOffset = 0, dataSize = 0, generation = 0;
+            uint32_t checksum = 0;
+
+            {
+                std::lock_guard<decltype(lock)> l (lock);
+
+                auto found = index.find (key);
+
+                if (found == index.end())
+                    return 0;
+
+                auto& entry = found->second;
+
+                if (destAddress == nullptr || destSize < entry.dataSize)
+                    return entry.dataSize;
+
+                recordOffset = entry.recordOffset;
+                dataOffset = entry.getDataOffset (found->first);
+                dataSize = entry.dataSize;
+                checksum = entry.checksum;
+                generation = fileGeneration;
+            }
+
+            bool dataIsValid = false;
+
+            try
+            {
+                std::ifstream in (file, std::ios::binary);
+                in.seekg (static_cast<std::streamoff> (dataOffset));
+                in.read (static_cast<char*> (destAddress), static_cast<std::streamsize> (dataSize));
+
+                dataIsValid = in.gcount() == static_cast<std::streamsize> (dataSize)
+                               && calculateChecksum (destAddress, dataSize) == checksum;
+            }
+            catch (...) {}
+
+            std::lock_guard<decltype(lock)> l (lock);
+
+            if (generation != fileGeneration)
+                continue;
+
+            auto found = index.find (key);
+
+            if (found == index.end() || found->second.recordOffset != recordOffset)
+                continue;
+
+            if (! dataIsValid)
+            {
+                evict (found->first);
+                return 0;
+            }
+
+            lruOrder.splice (lruOrder.begin(), lruOrder, found->second.lruPosition);
+            return dataSize;
+        }
+
+        return 0;
+    }
+
+private:
+    //==============================================================================
+    static constexpr uint32_t recordMagicNumber = 0x4b504d43; // "CMPK"
+    static constexpr uint32_t removedRecordFlag = 1;
+    static constexpr uint64_t minimumBytesToCompact = 1024 * 1024;
+    static constexpr int maxReloadAttempts = 3;
+
+    struct RecordHeader
+    {
+        uint32_t magic = recordMagicNumber;
+        uint32_t keyLength = 0;
+        uint64_t dataSize = 0;
+        uint32_t checksum = 0;
+        uint32_t flags = 0;
+
+        uint64_t getRecordSize() const      { return sizeof (RecordHeader) + keyLength + dataSize; }
+    };
+
+    struct Entry
+    {
+        uint64_t recordOffset = 0, dataSize = 0;
+        uint32_t checksum = 0;
+        std::list<std::string>::iterator lruPosition;
+
+        uint64_t getDataOffset (const std::string& key) const   { return recordOffset + sizeof (RecordHeader) + key.length(); }
+        uint64_t getRecordSize (const std::string& key) const   { return sizeof (RecordHeader) + key.length() + dataSize; }
+    };
+
+    std::filesystem::path file;
+    uint64_t maxTotalBytes = 0;
+    std::mutex lock;
+    std::fstream stream;
+    uint64_t fileSize = 0, liveDataBytes = 0, deadBytes = 0;
+    /// Incremented whenever compaction replaces the file, which moves all the records
+    uint64_t fileGeneration = 0;
+
+    std::unordered_map<std::string, Entry> index;
+    std::list<std::string> lruOrder; // most recently used first
+
+    choc::threading::TaskThread compactionThread;
+
+    //==============================================================================
+    static uint32_t calculateChecksum (const void* data, uint64_t size)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        auto bytes = static_cast<const uint8_t*> (data);
+
+        for (uint64_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+
+        return hash;
+    }
+
+    void openFile()
+    {
+        try
+        {
+            if (! exists (file))
+                std::ofstream newFile (file, std::ios::binary);
+
+            stream.open (file, std::ios::binary | std::ios::in | std::ios::out);
+            fileSize = stream.is_open() ? static_cast<uint64_t> (file_size (file)) : 0;
+        }
+        catch (...)
+        {
+            stream.close();
+            fileSize = 0;
+        }
+    }
+
+    void loadIndex()
+    {
+        if (! stream.is_open())
+            return;
+
+        uint64_t position = 0;
+
+        while (position + sizeof (RecordHeader) <= fileSize)
+        {
+            RecordHeader header;
+            stream.seekg (static_cast<std::streamoff> (position));
+            stream.read (reinterpret_cast<char*> (std::addressof (header)), sizeof (header));
+
+            if (stream.gcount() != static_cast<std::streamsize> (sizeof (header))
+                 || header.magic != recordMagicNumber
+                 || position + header.getRecordSize() > fileSize)
+                break;
+
+            std::string key (header.keyLength, '\0');
+            stream.read (key.data(), static_cast<std::streamsize> (header.keyLength));
+
+            if (stream.gcount() != static_cast<std::streamsize> (header.keyLength))
+                break;
+
+            removeFromIndex (index.find (key));
+
+            if ((header.flags & removedRecordFlag) == 0)
+                addToIndex (std::move (key), position, header.dataSize, header.checksum);
+
+            position += header.getRecordSize();
+        }
+
+        stream.clear();
+
+        // Anything after the last complete record must be the remains of an interrupted write
+        if (position != fileSize)
+        {
+            try
+            {
+                stream.close();
+                resize_file (file, position);
+                openFile();
+            }
+            catch (...) {}
+        }
+
+        deadBytes = fileSize - liveDataBytes;
+
+        for (auto& i : index)
+            deadBytes -= (i.second.getRecordSize (i.first) - i.second.dataSize);
+    }
+
+    bool appendRecord (const RecordHeader& header, std::string_view key, const void* data)
+    {
+        stream.clear();
+        stream.seekp (static_cast<std::streamoff> (fileSize));
+        stream.write (reinterpret_cast<const char*> (std::addressof (header)), sizeof (header));
+        stream.write (key.data(), static_cast<std::streamsize> (key.length()));
+
+        if (header.dataSize != 0)
+            stream.write (static_cast<const char*> (data), static_cast<std::streamsize> (header.dataSize));
+
+        stream.flush();
+
+        if (stream.good())
+        {
+            fileSize += header.getRecordSize();
+            return true;
+        }
+
+        // try to chop off whatever part of the record was written
+        stream.clear();
+
+        try
+        {
+            stream.close();
+            resize_file (file, fileSize);
+        }
+        catch (...) {}
+
+        openFile();
+        return false;
+    }
+
+    void addToIndex (std::string key, uint64_t recordOffset, uint64_t dataSize, uint32_t checksum)
+    {
+        lruOrder.push_front (key);
+
+        Entry entry;
+        entry.recordOffset = recordOffset;
+        entry.dataSize = dataSize;
+        entry.checksum = checksum;
+        entry.lruPosition = lruOrder.begin();
+
+        liveDataBytes += dataSize;
+        index[std::move (key)] = entry;
+    }
+
+    void removeFromIndex (std::unordered_map<std::string, Entry>::iterator i)
+    {
+        if (i != index.end())
+        {
+            liveDataBytes -= i->second.dataSize;
+            deadBytes += i->second.getRecordSize (i->first);
+            lruOrder.erase (i->second.lruPosition);
+            index.erase (i);
+        }
+    }
+
+    /// Drops an entry, and appends a record to say that it has gone, so that it
+    /// doesn't come back when the index is next loaded.
+    void evict (std::string key)
+    {
+        removeFromIndex (index.find (key));
+
+        RecordHeader header;
+        header.keyLength = static_cast<uint32_t> (key.length());
+        header.flags = removedRecordFlag;
+
+        if (appendRecord (header, key, nullptr))
+            deadBytes += header.getRecordSize();
+    }
+
+    //==============================================================================
+    struct RecordToCopy
+    {
+        std::string key;
+        uint64_t oldOffset, newOffset, size;
+    };
+
+    void compactIfNeeded()
+    {
+        // The live records are copied without holding the lock, so that the cache can still
+        // be used in the meantime. Because the file is only ever appended to, the records that
+        // are being copied won't change, and anything written during the copy is added after.
+        std::vector<RecordToCopy> records;
+        uint64_t snapshotFileSize = 0;
+
+        {
+            std::lock_guard<decltype(lock)> l (lock);
+
+            if (! stream.is_open() || deadBytes < minimumBytesToCompact || deadBytes < liveDataBytes)
+                return;
+
+            records.reserve (lruOrder.size());
+
+            // Write the oldest entries first, so that the recency order survives a reload
+            for (auto key = lruOrder.rbegin(); key != lruOrder.rend(); ++key)
+            {
+                auto& entry = index[*key];
+                records.push_back ({ *key, entry.recordOffset, 0, entry.getRecordSize (*key) });
+            }
+
+            snapshotFileSize = fileSize;
+        }
+
+        auto tempFile = file;
+        tempFile += ".tmp";
+
+        try
+        {
+            std::ifstream in (file, std::ios::binary);
+            std::ofstream out (tempFile, std::ios::binary | std::ios::trunc);
+            std::vector<char> buffer;
+            uint64_t newSize = 0;
+
+            for (auto& record : records)
+            {
+                buffer.resize (static_cast<size_t> (record.size));
+                in.seekg (static_cast<std::streamoff> (record.oldOffset));
+                in.read (buffer.data(), static_cast<std::streamsize> (record.size));
+
+                if (in.gcount() != static_cast<std::streamsize> (record.size))
+                    throw std::runtime_error ("read failed");
+
+                out.write (buffer.data(), static_cast<std::streamsize> (record.size));
+                record.newOffset = newSize;
+                newSize += record.size;
+            }
+
+            in.close();
+
+            std::lock_guard<decltype(lock)> l (lock);
+
+            if (! stream.is_open())
+                throw std::runtime_error ("file closed");
+
+            // Anything that was appended during the copy goes on the end, as it is
+            auto numNewBytes = fileSize - snapshotFileSize;
+            auto sizeBeforeNewRecords = newSize;
+
+            if (numNewBytes != 0)
+            {
+                buffer.resize (static_cast<size_t> (numNewBytes));
+                stream.clear();
+                stream.seekg (static_cast<std::streamoff> (snapshotFileSize));
+                stream.read (buffer.data(), static_cast<std::streamsize> (numNewBytes));
+
+                if (stream.gcount() != static_cast<std::streamsize> (numNewBytes))
+                    throw std::runtime_error ("read failed");
+
+                out.write (buffer.data(), static_cast<std::streamsize> (numNewBytes));
+                newSize += numNewBytes;
+            }
+
+            out.flush();
+
+            if (! out.good())
+                throw std::runtime_error ("write failed");
+
+            out.close();
+            stream.close();
+            std::filesystem::rename (tempFile, file);
+            ++fileGeneration;
+
+            // Entries that were replaced or evicted during the copy have been removed from the
+            // index, and their newer records (or removal records) came after the snapshot
+            for (auto& record : records)
+            {
+                auto found = index.find (record.key);
+
+                if (found != index.end() && found->second.recordOffset == record.oldOffset)
+                    found->second.recordOffset = record.newOffset;
+            }
+
+            for (auto& entry : index)
+                if (entry.second.recordOffset >= snapshotFileSize)
+                    entry.second.recordOffset = entry.second.recordOffset - snapshotFileSize + sizeBeforeNewRecords;
+
+            deadBytes = newSize - liveDataBytes;
+
+            for (auto& entry : index)
+                deadBytes -= (entry.second.getRecordSize (entry.first) - entry.second.dataSize);
+
+            stream.clear();
+            openFile();
+        }
+        catch (...)
+        {
+            std::error_code errorCode;
+            std::filesystem::remove (tempFile, errorCode);
+
+            std::lock_guard<decltype(lock)> l (lock);
+            stream.clear();
+
+            if (! stream.is_open())
+                openFile();
+        }
+    }
+};
+
+} // namespace cmaj
@@ -241,6 +241,14 @@ struct Patch
 
     void setCPUInfoMonitorChunkSize (uint32_t);
 
+    /// Returns the distribution of times taken by the performer's advance() calls since
+    /// playback started or resetAdvanceTimingStats() was called. This doesn't block the
+    /// audio thread, so a host can poll it at any time from the message thread.
+    AudioMIDIPerformer::AdvanceTimingStats getAdvanceTimingStats() const;
+
+    /// Clears the statistics returned by getAdvanceTimingStats().
+    void resetAdvanceTimingStats();
+
     /// Enables/disables monitoring data for an endpoint.
     /// If granularity == 0, monitoring is disabled.
     /// For audio endpoints, granularity == 1 sends complete blocks of all incoming data
@@ -1078,7 +1086,7 @@ struct Patch::Build
 
             checkForStopSignal();
 
-            if (! resolvePatchExternals())
+            if (! resolvePatchExternals (engine, renderer->manifest))
             {
                 renderer->errors.add (cmaj::DiagnosticMessage::createError ("Failed to resolve external variables", {}));
                 return;
@@ -1188,27 +1196,6 @@ private:
         }
     }
 
-    bool resolvePatchExternals()
-    {
-        if (renderer->manifest.externals.isVoid())
-            return true;
-
-        if (! renderer->manifest.externals.isObject())
-            return false;
-
-        auto externals = engine.getExternalVariables();
-
-        for (auto& ev : externals.externals)
-        {
-            auto value = renderer->manifest.externals[ev.name];
-
-            if (! engine.setExternalVariable (ev.name.c_str(), replaceFilenameStringsWithAudioData (renderer->manifest, value, ev.annotation)))
-                return false;
-        }
-
-        return true;
-    }
-
     //==============================================================================
     void scanEndpointList()
     {
@@ -2141,6 +2128,20 @@ inline void Patch::setCustomAudioSourceForInput (const EndpointID& e, Patch::Cus
         renderer->setCustomAudioSource (e, source);
 }
 
+inline AudioMIDIPerformer::AdvanceTimingStats Patch::getAdvanceTimingStats() const
+{
+    if (renderer != nullptr && renderer->performer != nullptr)
+        return renderer->performer->getAdvanceTimingStats();
+
+    return {};
+}
+
+inline void Patch::resetAdvanceTimingStats()
+{
+    if (renderer != nullptr && renderer->performer != nullptr)
+        renderer->performer->resetAdvanceTimingStats();
+}
+
 inline void Patch::setCPUInfoMonitorChunkSize (uint32_t framesPerCallback)
 {
     clientEventQueue->cpu.framesPerCallback = framesPerCallback;
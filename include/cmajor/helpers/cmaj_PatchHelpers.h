@@ -29,6 +29,7 @@
 
 #include "../API/cmaj_Endpoints.h"
 #include "../API/cmaj_ExternalVariables.h"
+#include "../API/cmaj_Engine.h"
 
 #include <algorithm>
 
@@ -167,6 +168,11 @@ choc::value::Value replaceFilenameStringsWithAudioData (PatchManifest& manifest,
                                                         const choc::value::ValueView& sourceObject,
                                                         const choc::value::ValueView& annotation);
 
+/// Sets the values of a loaded engine's external variables from the "externals" section of
+/// a patch manifest, loading any audio files that they refer to.
+/// Returns false if any of them couldn't be set.
+bool resolvePatchExternals (Engine&, PatchManifest&);
+
 
 //==============================================================================
 //        _        _           _  _
@@ -420,6 +426,27 @@ inline choc::value::Value& TimelineEventGenerator::getPositionEvent (int64_t cur
 }
 
 //==============================================================================
+inline bool resolvePatchExternals (Engine& engine, PatchManifest& manifest)
+{
+    if (manifest.externals.isVoid())
+        return true;
+
+    if (! manifest.externals.isObject())
+        return false;
+
+    auto externals = engine.getExternalVariables();
+
+    for (auto& ev : externals.externals)
+    {
+        auto value = manifest.externals[ev.name];
+
+        if (! engine.setExternalVariable (ev.name.c_str(), replaceFilenameStringsWithAudioData (manifest, value, ev.annotation)))
+            return false;
+    }
+
+    return true;
+}
+
 inline choc::value::Value replaceFilenameStringsWithAudioData (PatchManifest& manifest,
                                                                const choc::value::ValueView& v,
                                                                const choc::value::ValueView& annotation)
@@ -0,0 +1,313 @@
+//
+//     ,ad888ba,                              88
+//    d8"'    "8b
+//   d8            88,dba,,adba,   ,aPP8A.A8  88     The Cmajor Toolkit
+//   Y8,           88    88    88  88     88  88
+//    Y8a.   .a8P  88    88    88  88,   ,88  88     (C)2022 Sound Stacks Ltd
+//     '"Y888Y"'   88    88    88  '"8bbP"Y8  88     https://cmajor.dev
+//                                           ,88
+//                                        888P"
+//
+//  Cmajor may be used under the terms of the ISC license:
+//
+//  Permission to use, copy, modify, and/or distribute this software for any purpose with or
+//  without fee is hereby granted, provided that the above copyright notice and this permission
+//  notice appear in all copies. THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+//  WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+//  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+//  WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//  CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "cmaj_PatchHelpers.h"
+#include "cmaj_EngineBuildPool.h"
+
+namespace cmaj
+{
+
+//==============================================================================
+/// Populates a link cache ahead of time for a set of patches.
+///
+/// Given a folder (or a list) of .cmajorpatch files, this builds every combination of
+/// patch, sample rate and maximum block size on an EngineBuildPool, linking each
+/// one against the cache that you supply, so that when the patch is later loaded with
+/// any of those settings, the link will be a cache hit.
+///
+/// Each build runs as a single task on the pool, which creates an engine, loads it,
+/// links it and then releases it, so there's only ever one engine per thread alive.
+/// The createEngine function and the cache object will be called from several
+/// threads at once, so they must be thread-safe.
+///
+struct PatchPrecompiler
+{
+    PatchPrecompiler (std::function<Engine()> createEngine,
+                      CacheDatabaseInterface::Ptr cache);
+
+    /// Describes the outcome of building one patch with one set of build settings.
+    struct Result
+    {
+        std::string manifestFile;
+        double frequency = 0;
+        uint32_t maxBlockSize = 0;
+        bool succeeded = false;
+        DiagnosticMessageList messages;
+
+        /// The time spent in Engine::link()
+        double linkSeconds = 0;
+        /// The number of bytes that the link wrote to the cache, or found there already
+        uint64_t cacheBytes = 0;
+        /// True if the link was able to reload its binary from the cache
+        bool wasAlreadyCached = false;
+    };
+
+    /// Returns all the .cmajorpatch files in a folder.
+    static std::vector<std::filesystem::path> findPatches (const std::filesystem::path& folder,
+                                                           bool searchSubFolders = true);
+
+    /// Builds all the patches in a folder with every combination of the frequencies
+    /// and block sizes provided, and returns a Result for each build.
+    std::vector<Result> precompileFolder (const std::filesystem::path& folder,
+                                          const std::vector<double>& frequencies,
+                                          const std::vector<uint32_t>& maxBlockSizes,
+                                          bool searchSubFolders = true);
+
+    /// Builds a list of patch files with every combination of the frequencies
+    /// and block sizes provided, and returns a Result for each build.
+    std::vector<Result> precompile (const std::vector<std::filesystem::path>& manifestFiles,
+                                    const std::vector<double>& frequencies,
+                                    const std::vector<uint32_t>& maxBlockSizes);
+
+    /// The number of builds to run in parallel. If this is 0, it'll use the number of CPU cores.
+    uint32_t numThreads = 0;
+
+private:
+    std::function<Engine()> createEngine;
+    CacheDatabaseInterface::Ptr cache;
+
+    // Each patch's manifest and program are parsed once, and shared by all of its builds
+    struct ParsedPatch
+    {
+        PatchManifest manifest;
+        Program program;
+    };
+
+    static bool parsePatch (ParsedPatch&, const std::string& manifestFile, DiagnosticMessageList&);
+    std::future<EngineBuildPool::BuildResult> startBuild (EngineBuildPool&, const ParsedPatch&, Result&);
+    static void finishBuild (std::future<EngineBuildPool::BuildResult>&, Result&);
+    static void addException (DiagnosticMessageList&);
+};
+
+
+
+
+//==============================================================================
+//        _        _           _  _
+//     __| |  ___ | |_   __ _ (_)| | ___
+//    / _` | / _ \| __| / _` || || |/ __|
+//   | (_| ||  __/| |_ | (_| || || |\__ \ _  _  _
+//    \__,_| \___| \__| \__,_||_||_||___/(_)(_)(_)
+//
+//   Code beyond this point is implementation detail...
+//
+//==============================================================================
+
+inline PatchPrecompiler::PatchPrecompiler (std::function<Engine()> create, CacheDatabaseInterface::Ptr c)
+    : createEngine (std::move (create)), cache (std::move (c))
+{
+    CMAJ_ASSERT (createEngine);
+}
+
+inline std::vector<std::filesystem::path> PatchPrecompiler::findPatches (const std::filesystem::path& folder, bool searchSubFolders)
+{
+    std::vector<std::filesystem::path> results;
+
+    auto addIfPatch = [&] (const std::filesystem::directory_entry& f)
+    {
+        if (f.is_regular_file() && f.path().extension() == ".cmajorpatch")
+            results.push_back (f.path());
+    };
+
+    try
+    {
+        if (searchSubFolders)
+            for (auto& f : std::filesystem::recursive_directory_iterator (folder))
+                addIfPatch (f);
+        else
+            for (auto& f : std::filesystem::directory_iterator (folder))
+                addIfPatch (f);
+    }
+    catch (...) {}
+
+    std::sort (results.begin(), results.end());
+    return results;
+}
+
+inline std::vector<PatchPrecompiler::Result> PatchPrecompiler::precompileFolder (const std::filesystem::path& folder,
+                                                                                 const std::vector<double>& frequencies,
+                                                                                 const std::vector<uint32_t>& maxBlockSizes,
+                                                                                 bool searchSubFolders)
+{
+    return precompile (findPatches (folder, searchSubFolders), frequencies, maxBlockSizes);
+}
+
+inline std::vector<PatchPrecompiler::Result> PatchPrecompiler::precompile (const std::vector<std::filesystem::path>& manifestFiles,
+                                                                           const std::vector<double>& frequencies,
+                                                                           const std::vector<uint32_t>& maxBlockSizes)
+{
+    std::vector<Result> results;
+    std::vector<std::future<EngineBuildPool::BuildResult>> builds;
+
+    // The running builds fill in their Result objects, so these mustn't be reallocated
+    results.reserve (manifestFiles.size() * frequencies.size() * maxBlockSizes.size());
+    builds.reserve (results.capacity());
+
+    EngineBuildPool pool (numThreads);
+
+    for (auto& file : manifestFiles)
+    {
+        ParsedPatch patch;
+        DiagnosticMessageList parseMessages;
+        bool parsedOK = parsePatch (patch, file.string(), parseMessages);
+
+        for (auto frequency : frequencies)
+        {
+            for (auto blockSize : maxBlockSizes)
+            {
+                auto& r = results.emplace_back();
+                r.manifestFile = file.string();
+                r.frequency = frequency;
+                r.maxBlockSize = blockSize;
+                r.messages = parseMessages;
+
+                auto& build = builds.emplace_back();
+
+                if (! parsedOK)
+                    continue;
+
+                if (! patch.manifest.needsToBuildSource)
+                {
+                    r.succeeded = true;
+                    continue;
+                }
+
+                build = startBuild (pool, patch, r);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < results.size(); ++i)
+        finishBuild (builds[i], results[i]);
+
+    return results;
+}
+
+inline bool PatchPrecompiler::parsePatch (ParsedPatch& patch, const std::string& manifestFile, DiagnosticMessageList& messages)
+{
+    try
+    {
+        patch.manifest.initialiseWithFile (manifestFile);
+
+        if (! patch.manifest.needsToBuildSource)
+            return true;
+
+        for (auto& file : patch.manifest.sourceFiles)
+        {
+            auto content = patch.manifest.readFileContent (file);
+
+            if (content.empty() && patch.manifest.getFileModificationTime (file) == std::filesystem::file_time_type())
+            {
+                messages.add (DiagnosticMessage::createError ("Could not open source file: " + file, {}));
+                return false;
+            }
+
+            if (! patch.program.parse (messages, patch.manifest.getFullPathForFile (file), std::move (content)))
+                return false;
+        }
+
+        return true;
+    }
+    catch (...)
+    {
+        addException (messages);
+    }
+
+    return false;
+}
+
+inline std::future<EngineBuildPool::BuildResult> PatchPrecompiler::startBuild (EngineBuildPool& pool, const ParsedPatch& patch, Result& result)
+{
+    // The task has its own copy of the manifest, but they all share the parsed program
+    return pool.addTask ([this, manifest = patch.manifest, program = patch.program, &result]() mutable
+    {
+        EngineBuildPool::BuildResult build;
+        auto engine = createEngine();
+
+        if (! engine)
+        {
+            build.messages.add (DiagnosticMessage::createError ("Failed to create an engine", {}));
+            return build;
+        }
+
+        engine.setBuildSettings (engine.getBuildSettings()
+                                   .setFrequency (result.frequency)
+                                   .setMaxBlockSize (result.maxBlockSize));
+
+        if (! engine.load (build.messages, program))
+            return build;
+
+        if (! resolvePatchExternals (engine, manifest))
+        {
+            build.messages.add (DiagnosticMessage::createError ("Failed to resolve external variables", {}));
+            return build;
+        }
+
+        build.succeeded = engine.link (build.messages, cache.get());
+
+        auto linkInfo = engine.getLastLinkInfo();
+        result.linkSeconds = linkInfo.linkSeconds;
+        result.wasAlreadyCached = linkInfo.usedCachedBinary;
+        result.cacheBytes = linkInfo.cacheBytesRead + linkInfo.cacheBytesWritten;
+        return build;
+    });
+}
+
+inline void PatchPrecompiler::finishBuild (std::future<EngineBuildPool::BuildResult>& pendingBuild, Result& result)
+{
+    if (! pendingBuild.valid())
+        return;
+
+    try
+    {
+        auto build = pendingBuild.get();
+        result.messages.add (build.messages);
+        result.succeeded = build.succeeded;
+    }
+    catch (...)
+    {
+        addException (result.messages);
+    }
+}
+
+inline void PatchPrecompiler::addException (DiagnosticMessageList& messages)
+{
+    try
+    {
+        throw;
+    }
+    catch (const choc::json::ParseError& e)
+    {
+        messages.add (DiagnosticMessage::createError (std::string (e.what()) + ":" + e.lineAndColumn.toString(), {}));
+    }
+    catch (const std::exception& e)
+    {
+        messages.add (DiagnosticMessage::createError (e.what(), {}));
+    }
+    catch (...)
+    {
+        messages.add (DiagnosticMessage::createError ("Unknown exception", {}));
+    }
+}
+
+} // namespace cmaj
@@ -21,7 +21,7 @@
 
 #pragma once
 
-#include "../COM/cmaj_PerformerInterface.h"
+#include "../COM/cmaj_ExtendedPerformerInterface.h"
 
 namespace cmaj
 {
@@ -29,7 +29,9 @@ namespace cmaj
 //==============================================================================
 /// A helper class that can be used if you need to wrap an Engine
 /// and intercept some of the calls it makes.
-struct PerformerProxy  : public PerformerInterface
+/// The ExtendedPerformerInterface methods are forwarded to the target if it
+/// supports them, or otherwise fall back to the basic PerformerInterface calls.
+struct PerformerProxy  : public ExtendedPerformerInterface
 {
     virtual ~PerformerProxy() = default;
 
@@ -48,7 +50,131 @@ struct PerformerProxy  : public PerformerInterface
     uint32_t getEventBufferSize() override                                                          { return target->getEventBufferSize(); }
     const char* getRuntimeError() override                                                          { return target->getRuntimeError(); }
 
+    bool isExtendedInterfaceAvailable() override                                        { return getExtendedTarget() != nullptr; }
+
+    // If the target doesn't support the extended interface, these fall back to the nearest
+    // basic PerformerInterface calls: timestamped events are delivered at the start of the
+    // block, channel arrays are only passed through when they have a single channel (which
+    // has the same layout as interleaved data), and the state/clone methods report failure.
+    void setInputFramesFromChannelArray (EndpointHandle e, const void* const* c, uint32_t n, uint32_t f) override
+    {
+        if (auto extended = getExtendedTarget())
+            extended->setInputFramesFromChannelArray (e, c, n, f);
+        else if (n == 1)
+            target->setInputFrames (e, c[0], f);
+    }
+
+    void copyOutputFramesToChannelArray (EndpointHandle e, void* const* c, uint32_t n, uint32_t f) override
+    {
+        if (auto extended = getExtendedTarget())
+            extended->copyOutputFramesToChannelArray (e, c, n, f);
+        else if (n == 1)
+            target->copyOutputFrames (e, c[0], f);
+    }
+
+    void addTimestampedInputEvent (EndpointHandle e, uint32_t index, uint32_t frame, const void* data) override
+    {
+        if (auto extended = getExtendedTarget())
+            extended->addTimestampedInputEvent (e, index, frame, data);
+        else
+            target->addInputEvent (e, index, data);
+    }
+
+    const void* getOutputFramesPointer (EndpointHandle e) override
+    {
+        auto extended = getExtendedTarget();
+        return extended != nullptr ? extended->getOutputFramesPointer (e) : nullptr;
+    }
+
+    void iterateAllOutputEvents (void* c, HandleOutputEventCallback h) override
+    {
+        if (auto extended = getExtendedTarget())
+            extended->iterateAllOutputEvents (c, h);
+    }
+
+    void process (const BlockDescriptor& block) override
+    {
+        if (auto extended = getExtendedTarget())
+            return extended->process (block);
+
+        target->setBlockSize (block.numFrames);
+
+        for (uint32_t i = 0; i < block.numStreamInputs; ++i)
+            target->setInputFrames (block.streamInputs[i].endpoint, block.streamInputs[i].frameData, block.numFrames);
+
+        for (uint32_t i = 0; i < block.numEventInputs; ++i)
+            target->addInputEvent (block.eventInputs[i].endpoint, block.eventInputs[i].typeIndex, block.eventInputs[i].eventData);
+
+        for (uint32_t i = 0; i < block.numValueInputs; ++i)
+            target->setInputValue (block.valueInputs[i].endpoint, block.valueInputs[i].valueData, block.valueInputs[i].numFramesToReachValue);
+
+        target->advance();
+
+        for (uint32_t i = 0; i < block.numStreamOutputs; ++i)
+            target->copyOutputFrames (block.streamOutputs[i].endpoint, block.streamOutputs[i].destData, block.numFrames);
+    }
+
+    size_t getStateSize() override
+    {
+        auto extended = getExtendedTarget();
+        return extended != nullptr ? extended->getStateSize() : 0;
+    }
+
+    bool saveState (void* dest) override
+    {
+        auto extended = getExtendedTarget();
+        return extended != nullptr && extended->saveState (dest);
+    }
+
+    bool restoreState (const void* source) override
+    {
+        auto extended = getExtendedTarget();
+        return extended != nullptr && extended->restoreState (source);
+    }
+
+    /// To support clone(), a derived class must override this to return a new proxy of its
+    /// own type, with a reference count of 1 and no target. clone() will then attach a clone
+    /// of the target to it, so that the copy intercepts the same calls as the original.
+    virtual PerformerProxy* createEmptyProxy()                                          { return {}; }
+
+    PerformerInterface* clone() override
+    {
+        auto extended = getExtendedTarget();
+
+        if (extended == nullptr)
+            return {};
+
+        if (auto newProxy = createEmptyProxy())
+        {
+            PerformerPtr result (newProxy);
+
+            if (auto clonedTarget = extended->clone())
+            {
+                newProxy->target = PerformerPtr (clonedTarget);
+                return result.getWithIncrementedRefCount();
+            }
+        }
+
+        return {};
+    }
+
     PerformerPtr target;
+
+private:
+    PerformerInterface* queriedTarget = nullptr;
+    ExtendedPerformerInterface* extendedTarget = nullptr;
+
+    // The query takes a lock, so this only does it again if the target has changed
+    ExtendedPerformerInterface* getExtendedTarget()
+    {
+        if (target.get() != queriedTarget)
+        {
+            queriedTarget = target.get();
+            extendedTarget = ExtendedPerformerInterface::query (queriedTarget);
+        }
+
+        return extendedTarget;
+    }
 };
 
 }